@@ -0,0 +1,480 @@
+/*
+ * Replays recorded and random key waveforms through SimpleKeyHandler and
+ * KeyPadHandler with a simulated clock and checks the callbacks, then
+ * measures the time a scan takes with key traffic.
+ *
+ * Results are printed on the serial monitor at 9600 baud.
+ *
+ * The sketch also runs on a PC, without the shield, with the minimal
+ * Arduino core in the host folder. The readKeys timing then shows the
+ * cost of the library without the bus transactions.
+ *
+ * g++ -Iextras/host -Isrc -x c++ extras/KeyHandlerTest.ino \
+ *     -x none extras/host/main.cpp src/RgbLcdKeyShield.cpp -o KeyHandlerTest
+ *
+ * run from the library folder, ./KeyHandlerTest exits with 1 on a failure.
+ * The random seed is printed, pass it to randomSeed in setup to repeat
+ * a failing run.
+ */
+
+#include "Arduino.h"
+#include <Wire.h>
+#include <RgbLcdKeyShield.h>
+
+RgbLcdKeyShield lcd;
+
+SimpleKeyHandler keyA;
+SimpleKeyHandler keyB;
+KeyPadHandler keyPad;
+
+/*
+ * A waveform is a list of segments, keys holds the level of key A
+ * (bit 0) and key B (bit 1) for the duration of the segment. For the
+ * KeyPadHandler keys holds the key bits as returned by readKeyBits.
+ */
+struct segment {
+	uint16_t duration;
+	uint8_t keys;
+};
+
+enum {
+	scanInterval = 2,	// ms between two reads
+	logSize = 48
+};
+
+uint32_t now;
+char eventLog[logSize];
+uint8_t logLength;
+uint16_t failures;
+
+void logEvent(const char *event) {
+	while (*event && logLength < logSize - 1)
+		eventLog[logLength++] = *event++;
+	eventLog[logLength] = 0;
+}
+
+void aShort() {
+	logEvent("aS ");
+}
+
+void aLong() {
+	logEvent("aL ");
+}
+
+void aRep() {
+	logEvent("aR ");
+}
+
+void bShort() {
+	logEvent("bS ");
+}
+
+void twoPress(const SimpleKeyHandler* senderKey,
+		const SimpleKeyHandler* otherKey) {
+	logEvent(senderKey == &keyA ? "2a" : "2b");
+	logEvent(otherKey == &keyA ? "a " : "b ");
+}
+
+/*
+ * Logs the key as s(elect), r(ight), d(own), u(p) or l(eft) followed by
+ * S(hort), L(ong) or R(epeat) plus the repeat count
+ */
+void padEvent(uint8_t key, KeyPadHandler::keyEvents event, uint16_t count) {
+	char text[8];
+	text[0] = "srdul"[key];
+	text[1] = "SLR"[event];
+	text[2] = 0;
+	if (event == KeyPadHandler::evRepPress)
+		snprintf(&text[2], sizeof(text) - 2, "%u", count);
+	logEvent(text);
+	logEvent(" ");
+}
+
+void padChord(uint8_t keyMask) {
+	char text[8];
+	snprintf(text, sizeof(text), "C%02X ", keyMask);
+	logEvent(text);
+}
+
+void play(const segment *wave, uint8_t count) {
+	for (uint8_t i = 0; i < count; ++i) {
+		uint16_t duration = pgm_read_word(&wave[i].duration);
+		uint8_t keys = pgm_read_byte(&wave[i].keys);
+		for (uint16_t t = 0; t < duration; t += scanInterval) {
+			keyA.read(keys & 1, now);
+			keyB.read(keys & 2, now);
+			now += scanInterval;
+		}
+	}
+}
+
+void playPad(const segment *wave, uint8_t count) {
+	for (uint8_t i = 0; i < count; ++i) {
+		uint16_t duration = pgm_read_word(&wave[i].duration);
+		uint8_t keys = pgm_read_byte(&wave[i].keys);
+		for (uint16_t t = 0; t < duration; t += scanInterval) {
+			keyPad.scan(keys, now);
+			now += scanInterval;
+		}
+	}
+}
+
+/*
+ * Plays a waveform in RAM
+ */
+void playPadRam(const segment *wave, uint8_t count) {
+	for (uint8_t i = 0; i < count; ++i)
+		for (uint16_t t = 0; t < wave[i].duration; t += scanInterval) {
+			keyPad.scan(wave[i].keys, now);
+			now += scanInterval;
+		}
+}
+
+void check(const __FlashStringHelper *name, const char *expected) {
+	bool pass = !strcmp(eventLog, expected);
+	if (!pass)
+		failures++;
+	Serial.print(pass ? F("pass ") : F("FAIL "));
+	Serial.print(name);
+	if (!pass) {
+		Serial.print(F(": expected \""));
+		Serial.print(expected);
+		Serial.print(F("\" got \""));
+		Serial.print(eventLog);
+		Serial.print('"');
+	}
+	Serial.println();
+	logLength = 0;
+	eventLog[0] = 0;
+}
+
+// recorded waveforms
+const segment shortPress[] PROGMEM = {
+		{ 100, 0 }, { 200, 1 }, { 100, 0 } };
+const segment bouncePress[] PROGMEM = {
+		{ 100, 0 }, { 2, 1 }, { 4, 0 }, { 2, 1 }, { 6, 0 }, { 200, 1 },
+		{ 4, 0 }, { 2, 1 }, { 4, 0 }, { 2, 1 }, { 100, 0 } };
+const segment glitch[] PROGMEM = {
+		{ 100, 0 }, { 10, 1 }, { 100, 0 } };
+const segment releaseGlitch[] PROGMEM = {
+		{ 100, 0 }, { 200, 1 }, { 10, 0 }, { 100, 1 }, { 100, 0 } };
+const segment longPress[] PROGMEM = {
+		{ 100, 0 }, { 1100, 1 }, { 100, 0 } };
+const segment overlap[] PROGMEM = {
+		{ 100, 0 }, { 100, 1 }, { 200, 3 }, { 100, 2 }, { 100, 0 } };
+const segment overlapReversed[] PROGMEM = {
+		{ 100, 0 }, { 100, 2 }, { 200, 3 }, { 100, 1 }, { 100, 0 } };
+const segment afterLong[] PROGMEM = {
+		{ 100, 0 }, { 700, 1 }, { 200, 3 }, { 100, 2 }, { 100, 0 } };
+const segment sequential[] PROGMEM = {
+		{ 100, 0 }, { 200, 1 }, { 100, 0 }, { 200, 2 }, { 100, 0 } };
+
+#define REPLAY(wave) play(wave, sizeof(wave) / sizeof(segment))
+
+// recorded waveforms for the KeyPadHandler
+enum {
+	kSelect = 1 << KeyPadHandler::keySelect,
+	kRight = 1 << KeyPadHandler::keyRight,
+	kDown = 1 << KeyPadHandler::keyDown,
+	kUp = 1 << KeyPadHandler::keyUp,
+	kLeft = 1 << KeyPadHandler::keyLeft
+};
+const segment padShort[] PROGMEM = {
+		{ 100, 0 }, { 200, kUp }, { 100, 0 } };
+const segment padBounce[] PROGMEM = {
+		{ 100, 0 }, { 2, kUp }, { 4, 0 }, { 2, kUp }, { 6, 0 }, { 200, kUp },
+		{ 4, 0 }, { 2, kUp }, { 4, 0 }, { 2, kUp }, { 100, 0 } };
+const segment padGlitch[] PROGMEM = {
+		{ 100, 0 }, { 10, kUp }, { 100, 0 } };
+const segment padReleaseGlitch[] PROGMEM = {
+		{ 100, 0 }, { 200, kUp }, { 10, 0 }, { 100, kUp }, { 100, 0 } };
+const segment padLong[] PROGMEM = {
+		{ 100, 0 }, { 1100, kUp }, { 100, 0 } };
+const segment padFastRepeat[] PROGMEM = {
+		{ 100, 0 }, { 650, kDown }, { 100, 0 } };
+const segment padOtherKeyRepeating[] PROGMEM = {
+		{ 100, 0 }, { 700, kSelect }, { 200, kSelect | kRight }, { 100, 0 } };
+const segment padChord3[] PROGMEM = {
+		{ 100, 0 }, { 100, kSelect }, { 100, kSelect | kRight },
+		{ 200, kSelect | kRight | kDown }, { 100, 0 } };
+const segment padChord4[] PROGMEM = {
+		{ 100, 0 }, { 60, kLeft }, { 60, kLeft | kUp },
+		{ 60, kLeft | kUp | kDown }, { 200, kLeft | kUp | kDown | kRight },
+		{ 100, kUp | kDown | kRight }, { 100, kDown | kRight }, { 100, 0 } };
+const segment padChordBouncing[] PROGMEM = {
+		{ 100, 0 }, { 2, kSelect }, { 4, 0 }, { 100, kSelect },
+		{ 4, kSelect | kLeft }, { 2, kSelect }, { 200, kSelect | kLeft },
+		{ 2, kSelect }, { 2, kSelect | kLeft }, { 100, kSelect }, { 100, 0 } };
+const segment padSequential[] PROGMEM = {
+		{ 100, 0 }, { 200, kUp }, { 100, 0 }, { 200, kDown }, { 100, 0 } };
+
+#define REPLAY_PAD(wave) playPad(wave, sizeof(wave) / sizeof(segment))
+
+/*
+ * Presses key A for a random time shorter than the long press time with
+ * random bounces shorter than the debounce time on both edges.
+ */
+void randomPress() {
+	segment wave[12];
+	uint8_t count = 0;
+	wave[count++] = {100, 0};
+	for (uint8_t i = 0; i < 4; ++i)
+		wave[count++] = {uint16_t(random(1, 6) * scanInterval), uint8_t(1 - (i & 1))};
+	wave[count++] = {uint16_t(random(100, 400)), 1};
+	for (uint8_t i = 0; i < 4; ++i)
+		wave[count++] = {uint16_t(random(1, 6) * scanInterval), uint8_t(i & 1)};
+	wave[count++] = {100, 0};
+	// the waveform is in RAM so it is played directly
+	for (uint8_t i = 0; i < count; ++i)
+		for (uint16_t t = 0; t < wave[i].duration; t += scanInterval) {
+			keyA.read(wave[i].keys & 1, now);
+			keyB.read(false, now);
+			now += scanInterval;
+		}
+}
+
+/*
+ * Presses key A and then key B before the long press time of key A
+ * expired, the keys are released in random order.
+ */
+void randomOverlap() {
+	segment wave[] = { { 100, 0 }, { uint16_t(random(60, 400)), 1 }, {
+			uint16_t(random(60, 200)), 3 }, { uint16_t(random(0, 100)),
+			uint8_t(random(1, 3)) }, { 100, 0 } };
+	for (uint8_t i = 0; i < sizeof(wave) / sizeof(segment); ++i)
+		for (uint16_t t = 0; t < wave[i].duration; t += scanInterval) {
+			keyA.read(wave[i].keys & 1, now);
+			keyB.read(wave[i].keys & 2, now);
+			now += scanInterval;
+		}
+}
+
+void replayTests(uint32_t start) {
+	now = start;
+	REPLAY(shortPress);
+	check(F("short press"), "aS ");
+	REPLAY(bouncePress);
+	check(F("bouncing press"), "aS ");
+	REPLAY(glitch);
+	check(F("glitch"), "");
+	REPLAY(releaseGlitch);
+	check(F("release glitch"), "aS ");
+	REPLAY(longPress);
+	check(F("long press"), "aL aR aR aR ");
+	REPLAY(overlap);
+	check(F("two keys"), "2ab ");
+	REPLAY(overlapReversed);
+	check(F("two keys reversed"), "2ba ");
+	REPLAY(afterLong);
+	check(F("second key after long press"), "aL aR aR ");
+	REPLAY(sequential);
+	check(F("sequential keys"), "aS bS ");
+	for (uint8_t i = 0; i < 50; ++i) {
+		randomPress();
+		if (strcmp(eventLog, "aS ")) {
+			check(F("random bounce"), "aS ");
+			return;
+		}
+		logLength = 0;
+		eventLog[0] = 0;
+	}
+	check(F("random bounce"), "");
+	for (uint8_t i = 0; i < 50; ++i) {
+		randomOverlap();
+		if (strcmp(eventLog, "2ab ")) {
+			check(F("random overlap"), "2ab ");
+			return;
+		}
+		logLength = 0;
+		eventLog[0] = 0;
+	}
+	check(F("random overlap"), "");
+}
+
+/*
+ * Presses a random key for a random time shorter than the long press time
+ * with random bounces shorter than the debounce time on both edges.
+ */
+void randomPadPress(char *expected) {
+	uint8_t key = random(KeyPadHandler::keyCount);
+	uint8_t bit = 1 << key;
+	segment wave[11];
+	uint8_t count = 0;
+	wave[count++] = {100, 0};
+	for (uint8_t i = 0; i < 4; ++i)
+		wave[count++] = {uint16_t(random(1, 6) * scanInterval), uint8_t(i & 1 ? 0 : bit)};
+	wave[count++] = {uint16_t(random(100, 400)), bit};
+	for (uint8_t i = 0; i < 4; ++i)
+		wave[count++] = {uint16_t(random(1, 6) * scanInterval), uint8_t(i & 1 ? bit : 0)};
+	wave[count++] = {100, 0};
+	playPadRam(wave, count);
+	snprintf(expected, 8, "%cS ", "srdul"[key]);
+}
+
+/*
+ * Presses two or three random keys, each before the long press time of
+ * the first one expired, and releases them in random order.
+ */
+void randomPadChord(char *expected) {
+	uint8_t keys[KeyPadHandler::keyCount] = { 0, 1, 2, 3, 4 };
+	uint8_t size = random(2, 4);
+	uint8_t mask = 0;
+	segment wave[8];
+	uint8_t count = 0;
+	wave[count++] = {100, 0};
+	for (uint8_t i = 0; i < size; ++i) {
+		// pick one of the keys not pressed yet
+		uint8_t pick = random(i, KeyPadHandler::keyCount);
+		uint8_t key = keys[pick];
+		keys[pick] = keys[i];
+		keys[i] = key;
+		mask |= 1 << key;
+		wave[count++] = {uint16_t(random(60, 150)), mask};
+	}
+	snprintf(expected, 8, "C%02X ", mask);
+	for (uint8_t i = 0; i < size - 1; ++i) {
+		// release one of the keys still pressed
+		uint8_t pick = random(i, size);
+		uint8_t key = keys[pick];
+		keys[pick] = keys[i];
+		keys[i] = key;
+		mask &= ~(1 << key);
+		wave[count++] = {uint16_t(random(0, 100)), mask};
+	}
+	wave[count++] = {100, 0};
+	playPadRam(wave, count);
+}
+
+void padReplayTests(uint32_t start) {
+	char expected[8];
+	now = start;
+	keyPad.onKeyEvent = padEvent;
+	keyPad.onChord = padChord;
+	REPLAY_PAD(padShort);
+	check(F("short press"), "uS ");
+	REPLAY_PAD(padBounce);
+	check(F("bouncing press"), "uS ");
+	REPLAY_PAD(padGlitch);
+	check(F("glitch"), "");
+	REPLAY_PAD(padReleaseGlitch);
+	check(F("release glitch"), "uS ");
+	REPLAY_PAD(padLong);
+	check(F("long press and repeat"), "uL uR0 uR1 uR2 ");
+	keyPad.setTiming(KeyPadHandler::keyDown, 20, 300, 100);
+	REPLAY_PAD(padFastRepeat);
+	check(F("per key timing"), "dL dR0 dR1 dR2 dR3 ");
+	keyPad.setTiming(KeyPadHandler::keyDown, 50, 500, 250);
+	REPLAY_PAD(padOtherKeyRepeating);
+	check(F("second key after long press"), "sL sR0 sR1 ");
+	REPLAY_PAD(padChord3);
+	check(F("three key chord"), "C07 ");
+	REPLAY_PAD(padChord4);
+	check(F("four key chord, staggered release"), "C1E ");
+	REPLAY_PAD(padChordBouncing);
+	check(F("bouncing chord"), "C11 ");
+	REPLAY_PAD(padSequential);
+	check(F("sequential keys"), "uS dS ");
+	for (uint8_t i = 0; i < 50; ++i) {
+		randomPadPress(expected);
+		if (strcmp(eventLog, expected)) {
+			check(F("random bounce"), expected);
+			return;
+		}
+		logLength = 0;
+		eventLog[0] = 0;
+	}
+	check(F("random bounce"), "");
+	for (uint8_t i = 0; i < 50; ++i) {
+		randomPadChord(expected);
+		if (strcmp(eventLog, expected)) {
+			check(F("random chord"), expected);
+			return;
+		}
+		logLength = 0;
+		eventLog[0] = 0;
+	}
+	check(F("random chord"), "");
+}
+
+/*
+ * Key bits of a busy key pad, bouncing keys and a chord, played in a
+ * loop for the timing of a scan
+ */
+const uint8_t traffic[16] = {
+		0, kUp, 0, kUp, kUp, kUp, kUp | kDown, kUp, kUp | kDown, kUp | kDown,
+		kUp | kDown | kSelect, kUp | kDown, kUp | kDown | kSelect, kSelect,
+		0, kSelect };
+
+void setup() {
+	Serial.begin(9600);
+	Wire.begin();
+	Wire.setClock(400000L);
+	uint16_t seed = analogRead(0);
+	randomSeed(seed);
+	Serial.print(F("random seed "));
+	Serial.println(seed);
+
+	keyA.onShortPress = aShort;
+	keyA.onLongPress = aLong;
+	keyA.onRepPress = aRep;
+	keyB.onShortPress = bShort;
+	SimpleKeyHandler::onTwoPress = twoPress;
+
+	Serial.println(F("SimpleKeyHandler replay"));
+	replayTests(0);
+	Serial.println(F("millis wraparound"));
+	replayTests(0xffffff00);
+	Serial.println(F("KeyPadHandler replay"));
+	padReplayTests(0);
+	Serial.println(F("16 bit time stamp wraparound"));
+	padReplayTests(0xff00);
+	Serial.println(F("millis wraparound"));
+	padReplayTests(0xffffff00);
+	Serial.print(failures);
+	Serial.println(F(" failures"));
+	Serial.println();
+
+	// restore the static callback as the shield keys share it
+	SimpleKeyHandler::onTwoPress = nullptr;
+	keyPad.clear();
+
+	// 1000 scans, the us for all are the ns per scan
+	lcd.begin();
+	uint32_t time = micros();
+	for (uint16_t i = 0; i < 1000; ++i)
+		lcd.readKeys();
+	time = micros() - time;
+	Serial.print(F("readKeys: "));
+	Serial.print(time);
+	Serial.println(F(" ns per scan"));
+
+	// scans 2 ms apart
+	time = micros();
+	for (uint16_t i = 0; i < 1000; ++i) {
+		uint8_t keys = traffic[i & 15];
+		lcd.keySelect.read(keys & kSelect, now);
+		lcd.keyRight.read(keys & kRight, now);
+		lcd.keyDown.read(keys & kDown, now);
+		lcd.keyUp.read(keys & kUp, now);
+		lcd.keyLeft.read(keys & kLeft, now);
+		now += scanInterval;
+	}
+	time = micros() - time;
+	Serial.print(F("five SimpleKeyHandler reads: "));
+	Serial.print(time);
+	Serial.println(F(" ns per scan"));
+
+	time = micros();
+	for (uint16_t i = 0; i < 1000; ++i) {
+		keyPad.scan(traffic[i & 15], now);
+		now += scanInterval;
+	}
+	time = micros() - time;
+	Serial.print(F("KeyPadHandler scan: "));
+	Serial.print(time);
+	Serial.println(F(" ns per scan"));
+}
+
+void loop() {
+
+}
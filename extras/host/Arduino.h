@@ -0,0 +1,100 @@
+/*
+ * Minimal Arduino core for building the key handler replay tests of
+ * KeyHandlerTest.ino on a PC, see the build command in the sketch.
+ * Only what the library and the sketch use is provided. The time
+ * functions use the clock of the PC.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binary.h"
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+int analogRead(uint8_t pin);
+
+class __FlashStringHelper;
+#define F(string) ((const __FlashStringHelper *) (string))
+
+class Print {
+public:
+	virtual ~Print() {
+	}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size) {
+		size_t n = 0;
+		while (size--)
+			n += write(*buffer++);
+		return n;
+	}
+	size_t write(const char *str) {
+		return write((const uint8_t *) str, strlen(str));
+	}
+	size_t print(const __FlashStringHelper *str) {
+		return write((const char *) str);
+	}
+	size_t print(const char *str) {
+		return write(str);
+	}
+	size_t print(char c) {
+		return write((uint8_t) c);
+	}
+	size_t print(long value) {
+		char buffer[12];
+		snprintf(buffer, sizeof(buffer), "%ld", value);
+		return write(buffer);
+	}
+	size_t print(unsigned long value) {
+		char buffer[12];
+		snprintf(buffer, sizeof(buffer), "%lu", value);
+		return write(buffer);
+	}
+	size_t print(int value) {
+		return print((long) value);
+	}
+	size_t print(unsigned int value) {
+		return print((unsigned long) value);
+	}
+	size_t println() {
+		return write('\n');
+	}
+	template<typename T> size_t println(T value) {
+		return print(value) + println();
+	}
+};
+
+class HardwareSerial: public Print {
+public:
+	void begin(unsigned long) {
+	}
+	size_t write(uint8_t c) {
+		return putchar(c) == EOF ? 0 : 1;
+	}
+	using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif // Arduino_h
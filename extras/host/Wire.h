@@ -0,0 +1,35 @@
+/*
+ * Wire library without a bus for building KeyHandlerTest.ino on a PC,
+ * every transmission succeeds and every read returns zero.
+ */
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include "Arduino.h"
+
+class TwoWire {
+public:
+	void begin() {
+	}
+	void setClock(uint32_t) {
+	}
+	void beginTransmission(uint8_t) {
+	}
+	uint8_t endTransmission(bool = true) {
+		return 0;
+	}
+	size_t write(uint8_t) {
+		return 1;
+	}
+	uint8_t requestFrom(int, int quantity) {
+		return quantity;
+	}
+	int read() {
+		return 0;
+	}
+};
+
+extern TwoWire Wire;
+
+#endif // TwoWire_h
@@ -0,0 +1,54 @@
+/*
+ * Runs KeyHandlerTest.ino once on a PC, the exit code is non zero when
+ * a replay test failed.
+ */
+
+#include <chrono>
+#include <thread>
+#include "Arduino.h"
+#include "Wire.h"
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+extern uint16_t failures;
+void setup();
+
+static const std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+uint32_t millis() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+}
+
+void delay(uint32_t ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+long random(long howBig) {
+	return howBig ? rand() % howBig : 0;
+}
+
+long random(long howSmall, long howBig) {
+	return howSmall < howBig ? howSmall + random(howBig - howSmall) : howSmall;
+}
+
+void randomSeed(unsigned long seed) {
+	srand(seed);
+}
+
+int analogRead(uint8_t) {
+	// a fixed seed keeps the random tests repeatable
+	return 0;
+}
+
+int main() {
+	setup();
+	return failures ? 1 : 0;
+}
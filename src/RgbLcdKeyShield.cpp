@@ -56,21 +56,29 @@ void SimpleKeyHandler::clear() {
  * To be placed in the main loop. Expect TRUE if a key is pressed.
  */
 void SimpleKeyHandler::read(bool keyState) {
+	read(keyState, millis());
+}
+
+/*
+ * Same as read(bool keyState) with the time in ms passed, e.g. millis().
+ * The time comparisons are wraparound safe.
+ */
+void SimpleKeyHandler::read(bool keyState, uint32_t now) {
 	switch (_previousState) {
 	case keyOff:
 		if (keyState) {
 			// when on advance to the next state
 			_previousState = keyToOn;
-			_nextValidRead = millis() + debounce;
+			_nextValidRead = now + debounce;
 		}
 		break;
 	case keyToOn:
 		// ignore the key until debounce time expired
-		if (millis() >= _nextValidRead) {
+		if ((int32_t) (now - _nextValidRead) >= 0) {
 			if (keyState) {
 				// when still on advance to the next state
 				_previousState = keyOn;
-				_nextValidRead = millis() + longPress;
+				_nextValidRead = now + longPress;
 				// disable the other keys
 				if (!_activeKey)
 					_activeKey = this;
@@ -87,11 +95,11 @@ void SimpleKeyHandler::read(bool keyState) {
 		if (!keyState) {
 			// when off advance to the next state
 			_previousState = keyToOff;
-			_nextValidRead = millis() + debounce;
+			_nextValidRead = now + debounce;
 		} else {
 			// callback after long press and repeat after the repeat interval
-			if (millis() >= _nextValidRead) {
-				_nextValidRead = millis() + repeatInterval;
+			if ((int32_t) (now - _nextValidRead) >= 0) {
+				_nextValidRead = now + repeatInterval;
 				// prevent events when disabled
 				if ((_allowEvents)) {
 					if (onLongPress && _count == 0)
@@ -116,7 +124,7 @@ void SimpleKeyHandler::read(bool keyState) {
 		break;
 	case keyToOff:
 		// ignore the key until debounce time expired
-		if (millis() >= _nextValidRead) {
+		if ((int32_t) (now - _nextValidRead) >= 0) {
 			if (!keyState) {
 				// when off advance to the next state
 				_previousState = keyOff;
@@ -129,9 +137,11 @@ void SimpleKeyHandler::read(bool keyState) {
 					_activeKey = nullptr;
 					_otherKey = nullptr;
 				}
-			} else
-				// otherwise it was a glitch
+			} else {
+				// otherwise it was a glitch, restart the long press or repeat time
 				_previousState = keyOn;
+				_nextValidRead = now + (_count ? repeatInterval : longPress);
+			}
 		}
 		break;
 	}
@@ -144,7 +154,127 @@ bool SimpleKeyHandler::isPressed() {
 	return _previousState == keyOn;
 }
 
-//--------------------------------RgbLcdKeyShield----------------------------
+//--------------------------------KeyPadHandler------------------------------
+
+KeyPadHandler::KeyPadHandler() {
+	clear();
+	for (uint8_t key = 0; key < keyCount; ++key)
+		setTiming(key, debounce, longPress, repeatInterval);
+	_nextEvent = 0;
+	_count = 0;
+	_raw = 0;
+	_stable = 0;
+	_chord = 0;
+	_activeKey = noKey;
+}
+
+/*
+ * Sets the debounce time (ms), long press time and repeat interval
+ * (ms, rounded down to 10 ms with a maximum of 2550 ms) of a key.
+ */
+void KeyPadHandler::setTiming(uint8_t key, uint8_t debounceTime,
+		uint16_t longPressTime, uint16_t repeatTime) {
+	if (key >= keyCount)
+		return;
+	_timing[key].debounce = debounceTime;
+	_timing[key].longPress = min(longPressTime / tick, 255);
+	_timing[key].repeatInterval = min(repeatTime / tick, 255);
+}
+
+/*
+ * Clears the callback pointers.
+ */
+void KeyPadHandler::clear() {
+	onKeyEvent = nullptr;
+	onChord = nullptr;
+}
+
+/*
+ * To be placed in the main loop with the key bits from
+ * RgbLcdShield::readKeyBits and the time in ms, e.g. millis().
+ */
+void KeyPadHandler::scan(uint8_t keyBits, uint32_t now) {
+	uint16_t time = now;
+	keyBits &= allKeys;
+	uint8_t changed = keyBits ^ _raw;
+	_raw = keyBits;
+	// only the keys that differ from their debounced state need attention
+	uint8_t pending = keyBits ^ _stable;
+	for (uint8_t key = 0, bit = 1; pending; ++key, bit <<= 1) {
+		if (!(pending & bit))
+			continue;
+		pending &= ~bit;
+		// restart the debounce time on every level change
+		if (changed & bit)
+			_edge[key] = time;
+		if ((uint16_t) (time - _edge[key]) >= _timing[key].debounce) {
+			_stable ^= bit;
+			if (keyBits & bit)
+				_pressed(key, time);
+			else
+				_released(key);
+		}
+	}
+	// long press and repeat for the active key unless it is part of a chord
+	if (_activeKey != noKey && !(_chord & (_chord - 1))
+			&& (int16_t) (time - _nextEvent) >= 0) {
+		_nextEvent = time + _timing[_activeKey].repeatInterval * tick;
+		if (onKeyEvent) {
+			if (_count == 0)
+				onKeyEvent(_activeKey, evLongPress, 0);
+			onKeyEvent(_activeKey, evRepPress, _count);
+		}
+		_count++;
+	}
+}
+
+/*
+ * Checks if the key is in the debounced pressed state
+ */
+bool KeyPadHandler::isPressed(uint8_t key) {
+	return _stable & (1 << key);
+}
+
+/*
+ * Returns the debounced state of all keys
+ */
+uint8_t KeyPadHandler::pressedKeys() {
+	return _stable;
+}
+
+/*
+ * Helper function called when a key is debounced as pressed
+ */
+void KeyPadHandler::_pressed(uint8_t key, uint16_t time) {
+	if (_stable == (1 << key)) {
+		// first key pressed becomes the active key
+		_activeKey = key;
+		_chord = _stable;
+		_count = 0;
+		_nextEvent = time + _timing[key].longPress * tick;
+	} else if (_activeKey != noKey && _count == 0)
+		// join the chord before the long press time expired
+		_chord |= 1 << key;
+}
+
+/*
+ * Helper function called when a key is debounced as released
+ */
+void KeyPadHandler::_released(uint8_t key) {
+	bool isChord = _chord & (_chord - 1);
+	if (key == _activeKey) {
+		if (!isChord && _count == 0 && onKeyEvent)
+			onKeyEvent(key, evShortPress, 0);
+		_activeKey = noKey;
+	}
+	if (!_stable) {
+		if (isChord && onChord)
+			onChord(_chord);
+		_chord = 0;
+	}
+}
+
+//--------------------------------RgbLcdShield-------------------------------
 
 /*
  * WTF? DB4 is connected to GPB4, DB5 to GPB3, DB6 to GPB2 and DB7 to GPB1
@@ -157,9 +287,9 @@ bool SimpleKeyHandler::isPressed() {
  * compiled only once when more instances of this class are created.
  */
 #ifdef __AVR__
-	const uint8_t RgbLcdKeyShield::_nibbleToPin[16] PROGMEM = {
+	const uint8_t RgbLcdShield::_nibbleToPin[16] PROGMEM = {
 #else
-	const uint8_t RgbLcdKeyShield::_nibbleToPin[16] = {
+	const uint8_t RgbLcdShield::_nibbleToPin[16] = {
 #endif // __AVR__
 			B10100000,	// 0000
 			B10110000,	// 0001
@@ -179,82 +309,191 @@ bool SimpleKeyHandler::isPressed() {
 			B10111110	// 1111
 			};
 
-gbLcdKeyShieldI2C::RgbLcdKeyShieldI2C(bool invertedBacklight) {
+/*
+ * Code points in the A00 (Japanese) character ROM outside of ASCII,
+ * sorted by code point for a binary search.
+ * The upper half of the A02 (European) character ROM follows ISO 8859-1
+ * and needs no table.
+ */
+#ifdef __AVR__
+	const RgbLcdShield::romMapping RgbLcdShield::_romA00[25] PROGMEM = {
+#else
+	const RgbLcdShield::romMapping RgbLcdShield::_romA00[25] = {
+#endif // __AVR__
+			{ 0x00A2, 0xEC },	// cent
+			{ 0x00A5, 0x5C },	// yen
+			{ 0x00B0, 0xDF },	// degree
+			{ 0x00B5, 0xE4 },	// micro
+			{ 0x00B7, 0xA5 },	// middle dot
+			{ 0x00DF, 0xE2 },	// sharp s (beta)
+			{ 0x00E4, 0xE1 },	// a umlaut
+			{ 0x00F1, 0xEE },	// n tilde
+			{ 0x00F6, 0xEF },	// o umlaut
+			{ 0x00F7, 0xFD },	// division
+			{ 0x00FC, 0xF5 },	// u umlaut
+			{ 0x03A3, 0xF6 },	// Sigma
+			{ 0x03A9, 0xF4 },	// Omega
+			{ 0x03B1, 0xE0 },	// alpha
+			{ 0x03B2, 0xE2 },	// beta
+			{ 0x03B5, 0xE3 },	// epsilon
+			{ 0x03B8, 0xF2 },	// theta
+			{ 0x03C0, 0xF7 },	// pi
+			{ 0x03C1, 0xE6 },	// rho
+			{ 0x03C3, 0xE5 },	// sigma
+			{ 0x2190, 0x7F },	// left arrow
+			{ 0x2192, 0x7E },	// right arrow
+			{ 0x221A, 0xE8 },	// square root
+			{ 0x221E, 0xF3 },	// infinity
+			{ 0x2588, 0xFF }	// full block
+			};
+
+/*
+ * Special characters loaded on demand for code points missing in the
+ * character ROM, sorted by code point for a binary search. The base letter
+ * is shown when no special character location is free.
+ */
+#ifdef __AVR__
+	const RgbLcdShield::glyph RgbLcdShield::_glyphs[38] PROGMEM = {
+#else
+	const RgbLcdShield::glyph RgbLcdShield::_glyphs[38] = {
+#endif // __AVR__
+			{ 0x00C0, 'A', { B01000, B00100, B01110, B10001, B11111, B10001, B10001, B00000 } },	// A grave
+			{ 0x00C2, 'A', { B00100, B01010, B01110, B10001, B11111, B10001, B10001, B00000 } },	// A circumflex
+			{ 0x00C4, 'A', { B01010, B00000, B01110, B10001, B10001, B11111, B10001, B00000 } },	// A umlaut
+			{ 0x00C5, 'A', { B00100, B01010, B00100, B01110, B10001, B11111, B10001, B00000 } },	// A ring
+			{ 0x00C6, 'A', { B01111, B10100, B10100, B11110, B10100, B10100, B10111, B00000 } },	// AE
+			{ 0x00C7, 'C', { B01110, B10001, B10000, B10000, B10001, B01110, B00100, B01100 } },	// C cedilla
+			{ 0x00C8, 'E', { B01000, B00100, B11111, B10000, B11110, B10000, B11111, B00000 } },	// E grave
+			{ 0x00C9, 'E', { B00010, B00100, B11111, B10000, B11110, B10000, B11111, B00000 } },	// E acute
+			{ 0x00CA, 'E', { B00100, B01010, B11111, B10000, B11110, B10000, B11111, B00000 } },	// E circumflex
+			{ 0x00CB, 'E', { B01010, B00000, B11111, B10000, B11110, B10000, B11111, B00000 } },	// E diaeresis
+			{ 0x00CE, 'I', { B00100, B01010, B01110, B00100, B00100, B00100, B01110, B00000 } },	// I circumflex
+			{ 0x00CF, 'I', { B01010, B00000, B01110, B00100, B00100, B00100, B01110, B00000 } },	// I diaeresis
+			{ 0x00D4, 'O', { B00100, B01010, B01110, B10001, B10001, B10001, B01110, B00000 } },	// O circumflex
+			{ 0x00D6, 'O', { B01010, B00000, B01110, B10001, B10001, B10001, B01110, B00000 } },	// O umlaut
+			{ 0x00D8, 'O', { B01101, B10010, B10101, B10101, B10101, B01001, B10110, B00000 } },	// O stroke
+			{ 0x00D9, 'U', { B01000, B00100, B10001, B10001, B10001, B10001, B01110, B00000 } },	// U grave
+			{ 0x00DB, 'U', { B00100, B01010, B10001, B10001, B10001, B10001, B01110, B00000 } },	// U circumflex
+			{ 0x00DC, 'U', { B01010, B00000, B10001, B10001, B10001, B10001, B01110, B00000 } },	// U umlaut
+			{ 0x00E0, 'a', { B01000, B00100, B01110, B00001, B01111, B10001, B01111, B00000 } },	// a grave
+			{ 0x00E2, 'a', { B00100, B01010, B00000, B01110, B00001, B01111, B10001, B01111 } },	// a circumflex
+			{ 0x00E5, 'a', { B00100, B01010, B01110, B00001, B01111, B10001, B01111, B00000 } },	// a ring
+			{ 0x00E6, 'a', { B00000, B00000, B11010, B00101, B01111, B10100, B11111, B00000 } },	// ae
+			{ 0x00E7, 'c', { B00000, B00000, B01110, B10000, B10001, B01110, B00100, B01100 } },	// c cedilla
+			{ 0x00E8, 'e', { B01000, B00100, B01110, B10001, B11111, B10000, B01110, B00000 } },	// e grave
+			{ 0x00E9, 'e', { B00010, B00100, B01110, B10001, B11111, B10000, B01110, B00000 } },	// e acute
+			{ 0x00EA, 'e', { B00100, B01010, B01110, B10001, B11111, B10000, B01110, B00000 } },	// e circumflex
+			{ 0x00EB, 'e', { B01010, B00000, B01110, B10001, B11111, B10000, B01110, B00000 } },	// e diaeresis
+			{ 0x00EE, 'i', { B00100, B01010, B00000, B01100, B00100, B00100, B01110, B00000 } },	// i circumflex
+			{ 0x00EF, 'i', { B01010, B00000, B01100, B00100, B00100, B00100, B01110, B00000 } },	// i diaeresis
+			{ 0x00F4, 'o', { B00100, B01010, B00000, B01110, B10001, B10001, B01110, B00000 } },	// o circumflex
+			{ 0x00F8, 'o', { B00000, B00001, B01110, B10011, B10101, B11001, B01110, B10000 } },	// o stroke
+			{ 0x00F9, 'u', { B01000, B00100, B00000, B10001, B10001, B10011, B01101, B00000 } },	// u grave
+			{ 0x00FB, 'u', { B00100, B01010, B00000, B10001, B10001, B10011, B01101, B00000 } },	// u circumflex
+			{ 0x00FF, 'y', { B01010, B00000, B10001, B10001, B01111, B00001, B01110, B00000 } },	// y diaeresis
+			{ 0x0152, 'O', { B01111, B10100, B10100, B10110, B10100, B10100, B01111, B00000 } },	// OE
+			{ 0x0153, 'o', { B00000, B00000, B01010, B10101, B10111, B10100, B01011, B00000 } },	// oe
+			{ 0x0178, 'Y', { B01010, B00000, B10001, B01010, B00100, B00100, B00100, B00000 } },	// Y diaeresis
+			{ 0x20AC, 'E', { B00111, B01000, B11110, B01000, B11110, B01000, B00111, B00000 } }	// euro
+			};
+
+RgbLcdShield::RgbLcdShield(bool invertedBacklight) {
 	_shadowGPIOA = B11000000; // set bit 6 (red led) and 7 (green led) high
 	_shadowGPIOB = B00100001; // set bit 0 (blue led) and 5 (lcd enable) high
 	_shadowDisplayControl = displayControl | displayOnFlag; // set on, no cursor and no blinking
 	_shadowEntryModeSet = entryModeSet | left2RightFlag; // left to right, no shift
+	_address = 0;
 	_invertedBacklight = invertedBacklight;
+	_color = clWhite;
+	_backlightOn = true;
+	_busTimeout = 10000;
+	_retries = 2;
+	_lastError = busOk;
+	_errorCount = 0;
+	_resyncing = false;
+	_keySample = keySampleOff;
+	_keyBits = 0;
+	_keySampleMaxAge = 0;
+	_keySampleTime = 0;
+	noUtf8();
+	_glyphLocations = 0;
 }
 
 /*
  * initialize the MCP23017 and the LCD
  */
-void RgbLcdKeyShield::begin(void) {
+void RgbLcdShield::begin(void) {
 	// give the lcd some time to get ready
 	delay(100);
-	/*
-	 * Set the MCP23017 in 8 bit mode , sequential addressing
-	 * disabled and slew rate disabled by writing to
-	 * register 0x0b.
-	 * As this register is not present in 16 bit mode
-	 * we can safely write to it after a hot reset
-	 * of the controlling device as in this case the
-	 * MCP23017 is already in 8 bit mode which is possible
-	 * as the hardware reset of the device is not used.
-	 */
-	_wireTransmit(IOCON, B10101000);
-	// set bit 6 (red led) and 7 (green led) high
-	_wireTransmit(GPIOA, _shadowGPIOA);
-	// make bit 7 and 6 outputs
-	_wireTransmit(IODIRA, B00111111);
-	// enable pull-ups on input pins
-	_wireTransmit(GPPUA, B00111111);
-	// set bit 0 (blue led) and 5 (lcd enable) high
-	_wireTransmit(GPIOB, _shadowGPIOB);
-	// set all to output
-	_wireTransmit(IODIRB, B00000000);
-	// invert the 5 bits connected to the keys so that key pressed is high now
-	_wireTransmit(IPOLA, B00011111);
-
-	/* Initialize the lcd display
-	 * For an explanation what is going on see the Wikipedia
-	 * Hitachi HD44780 LCD controller entry
-	 */
-	Wire.beginTransmission(I2Caddr);
-	Wire.write(GPIOB);
-	_lcdWrite4(B0011, true);
-	Wire.endTransmission();
-
-	delay(5);
-
-	Wire.beginTransmission(I2Caddr);
-	Wire.write(GPIOB);
-	_lcdWrite4(B0011, true);
-	_lcdWrite4(B0011, true);
-	// should be in 8 bit mode now so set to 4 bit mode
-	_lcdWrite4(B0010, true);
-	// set 2 lines and 5x8 dots
-	_lcdWrite8(functionSet | lineMode2Flag, true);
-	// set on, no cursor and no blinking
-	_lcdWrite8(_shadowDisplayControl, true);
-	// left to right, no shift
-	_lcdWrite8(_shadowEntryModeSet, true);
-	Wire.endTransmission();
-
+#ifdef WIRE_HAS_TIMEOUT
+	// never hang on a stuck bus
+	Wire.setWireTimeout(_busTimeout, true);
+#endif // WIRE_HAS_TIMEOUT
+	resync();
 	// Clear entire display
 	clear();
 	// Return a shifted display to its original position
 	home();
 }
 
+/*
+ * Restores the MCP23017 registers and the lcd interface from the shadow
+ * registers without clearing the display. This is done automatically
+ * after a failed transmission, the text in transit may be lost. The cursor
+ * is set to where it would be without the failure. Makes up to 1 + retries attempts of about
+ * 6 ms each and returns true when successful.
+ */
+bool RgbLcdShield::resync() {
+	bool success = false;
+	_resyncing = true;
+	for (uint8_t attempt = 0; attempt <= _retries && !success; ++attempt)
+		success = _initialize();
+	_resyncing = false;
+	return success;
+}
+
+/*
+ * Sets the number of times a failed register write or resync is retried
+ */
+void RgbLcdShield::setRetries(uint8_t retries) {
+	_retries = retries;
+}
+
+/*
+ * Sets the maximum time in us a transmission may take before the
+ * bus is reset. Needs a Wire library with timeout support.
+ */
+void RgbLcdShield::setBusTimeout(uint16_t timeout) {
+	_busTimeout = timeout;
+#ifdef WIRE_HAS_TIMEOUT
+	Wire.setWireTimeout(_busTimeout, true);
+#endif // WIRE_HAS_TIMEOUT
+}
+
+/*
+ * Returns the last bus error, see busErrors
+ */
+uint8_t RgbLcdShield::getLastError() {
+	return _lastError;
+}
+
+/*
+ * Returns the number of bus errors, wraps around
+ */
+uint16_t RgbLcdShield::getErrorCount() {
+	return _errorCount;
+}
+
 /*
  * Clear the display and set the cursor in the upper left corner,
  * set left to right (undocumented :( )
  * takes about two milliseconds.
  */
-void RgbLcdKeyShield::clear() {
+void RgbLcdShield::clear() {
 	_lcdTransmit(clearDisplay, true);
+	_address = 0;
+	// no special character loaded for UTF-8 text is shown anymore
+	memset(_glyphIndex, noGlyph, sizeof(_glyphIndex));
 	// Synchronize left2RightFlag;
 	_shadowEntryModeSet = entryModeSet | left2RightFlag; // left to right, no shift
 	delay(2);
@@ -264,8 +503,9 @@ void RgbLcdKeyShield::clear() {
  * Set the cursor in the upper left corner,
  * takes about two milliseconds.
  */
-void RgbLcdKeyShield::home() {
+void RgbLcdShield::home() {
 	_lcdTransmit(returnHome, true);
+	_address = 0;
 	delay(2);
 }
 
@@ -273,27 +513,41 @@ void RgbLcdKeyShield::home() {
  * Sets the position of the cursor at which subsequent characters
  * will appear.
  */
-void RgbLcdKeyShield::setCursor(uint8_t col, uint8_t row) {
-	_lcdTransmit(setDdRamAdr | (col + row * 0x40), true);
+void RgbLcdShield::setCursor(uint8_t col, uint8_t row) {
+	_address = (col + row * 0x40) & 0x7f;
+	_lcdTransmit(setDdRamAdr | _address, true);
 }
 
 /*
  * Sets the color of the backlight of the display.
  */
-void RgbLcdKeyShield::setColor(colors color) {
-	uint8_t _color;
-	_invertedBacklight ? _color =~ color : _color = color;
-	bitWrite(_shadowGPIOA, 6, !(_color & clRed));
-	bitWrite(_shadowGPIOA, 7, !(_color & clGreen));
-	bitWrite(_shadowGPIOB, 0, !(_color & clBlue));
-	_wireTransmit(GPIOA, _shadowGPIOA);
-	_wireTransmit(GPIOB, _shadowGPIOB);
+void RgbLcdShield::setColor(colors color) {
+	_color = color;
+	// while the backlight is off the color is applied by backlight()
+	if (_backlightOn)
+		_writeColor(color);
+}
+
+/*
+ * Turns the backlight on with the last color set
+ */
+void RgbLcdShield::backlight() {
+	_backlightOn = true;
+	_writeColor(_color);
+}
+
+/*
+ * Turns the backlight off, the color is remembered
+ */
+void RgbLcdShield::noBacklight() {
+	_backlightOn = false;
+	_writeColor(clBlack);
 }
 
 /*
  * turn the display pixels on
  */
-void RgbLcdKeyShield::display() {
+void RgbLcdShield::display() {
 	_shadowDisplayControl |= displayOnFlag;
 	_lcdTransmit(_shadowDisplayControl, true);
 }
@@ -301,7 +555,7 @@ void RgbLcdKeyShield::display() {
 /*
  * turn the display pixels off
  */
-void RgbLcdKeyShield::noDisplay() {
+void RgbLcdShield::noDisplay() {
 	_shadowDisplayControl &= ~displayOnFlag;
 	_lcdTransmit(_shadowDisplayControl, true);
 }
@@ -309,7 +563,7 @@ void RgbLcdKeyShield::noDisplay() {
 /*
  * Enables the blinking of the selected character
  */
-void RgbLcdKeyShield::blink() {
+void RgbLcdShield::blink() {
 	_shadowDisplayControl |= blinkOnFlag;
 	_lcdTransmit(_shadowDisplayControl, true);
 }
@@ -317,7 +571,7 @@ void RgbLcdKeyShield::blink() {
 /*
  * Disables the blinking of the selected character
  */
-void RgbLcdKeyShield::noBlink() {
+void RgbLcdShield::noBlink() {
 	_shadowDisplayControl &= ~blinkOnFlag;
 	_lcdTransmit(_shadowDisplayControl, true);
 }
@@ -325,7 +579,7 @@ void RgbLcdKeyShield::noBlink() {
 /*
  * Enables the cursor
  */
-void RgbLcdKeyShield::cursor() {
+void RgbLcdShield::cursor() {
 	_shadowDisplayControl |= cursorOnFlag;
 	_lcdTransmit(_shadowDisplayControl, true);
 }
@@ -333,7 +587,7 @@ void RgbLcdKeyShield::cursor() {
 /*
  * Disables the cursor
  */
-void RgbLcdKeyShield::noCursor() {
+void RgbLcdShield::noCursor() {
 	_shadowDisplayControl &= ~cursorOnFlag;
 	_lcdTransmit(_shadowDisplayControl, true);
 }
@@ -341,14 +595,14 @@ void RgbLcdKeyShield::noCursor() {
 /*
  * Scrolls the display to the right
  */
-void RgbLcdKeyShield::scrollDisplayRight() {
+void RgbLcdShield::scrollDisplayRight() {
 	_lcdTransmit(curOrDispShift | displayShiftFlag | shiftRightFlag, true);
 }
 
 /*
  * Scrolls the display to the left
  */
-void RgbLcdKeyShield::scrollDisplayLeft() {
+void RgbLcdShield::scrollDisplayLeft() {
 	_lcdTransmit(curOrDispShift | displayShiftFlag, true);
 }
 
@@ -356,7 +610,7 @@ void RgbLcdKeyShield::scrollDisplayLeft() {
  * All subsequent characters written to the display will go
  * from left to right.
  */
-void RgbLcdKeyShield::leftToRight() {
+void RgbLcdShield::leftToRight() {
 	_shadowEntryModeSet |= left2RightFlag;
 	_lcdTransmit(_shadowEntryModeSet, true);
 }
@@ -365,7 +619,7 @@ void RgbLcdKeyShield::leftToRight() {
  * All subsequent characters written to the display will go
  * from right to left.
  */
-void RgbLcdKeyShield::rightToLeft() {
+void RgbLcdShield::rightToLeft() {
 	_shadowEntryModeSet &= ~left2RightFlag;
 	_lcdTransmit(_shadowEntryModeSet, true);
 }
@@ -373,15 +627,17 @@ void RgbLcdKeyShield::rightToLeft() {
 /*
  * Moves the cursor to the right
  */
-void RgbLcdKeyShield::moveCursorRight() {
+void RgbLcdShield::moveCursorRight() {
 	_lcdTransmit(curOrDispShift | shiftRightFlag, true);
+	_stepAddress(true);
 }
 
 /*
  * Moves the cursor to the left
  */
-void RgbLcdKeyShield::moveCursorLeft() {
+void RgbLcdShield::moveCursorLeft() {
 	_lcdTransmit(curOrDispShift, true);
+	_stepAddress(false);
 }
 
 /*
@@ -391,7 +647,7 @@ void RgbLcdKeyShield::moveCursorLeft() {
  * depending of the write direction.
  */
 
-void RgbLcdKeyShield::autoscroll() {
+void RgbLcdShield::autoscroll() {
 	_shadowEntryModeSet |= autoShiftFlag;
 	_lcdTransmit(_shadowEntryModeSet, true);
 }
@@ -399,39 +655,46 @@ void RgbLcdKeyShield::autoscroll() {
 /*
  * Turns off automatic scrolling of the display.
  */
-void RgbLcdKeyShield::noAutoscroll() {
+void RgbLcdShield::noAutoscroll() {
 	_shadowEntryModeSet &= ~autoShiftFlag;
 	_lcdTransmit(_shadowEntryModeSet, true);
 }
 
 /*
- * Loads a special character
- * The cursor position is lost after this call
+ * Loads a special character, the cursor position is kept
+ */
+void RgbLcdShield::createChar(uint8_t location, const uint8_t *charmap) {
+	_uploadChar(location, charmap, false);
+}
+
+/*
+ * Reads a special character back from the display,
+ * the cursor position is kept
  */
-void RgbLcdKeyShield::createChar(uint8_t location, const uint8_t *charmap) {
+void RgbLcdShield::readChar(uint8_t location, uint8_t *charmap) {
+	uint8_t address = _address;
 	location &= 0x7;   // we only have 8 memory locations 0-7
 	_lcdTransmit(setCgRamAdr | location << 3, true);
-	write(charmap, 8);
-	_lcdTransmit(setDdRamAdr, true);   // cursor position is lost
+	read(charmap, 8);
+	// reading the character memory moved the shadow address
+	_address = address;
+	_lcdTransmit(setDdRamAdr | _address, true);
 }
 
 #ifdef __AVR__
 /*
- * Loads a special character from program memory
- * The cursor position is lost after this call
+ * Loads a special character from program memory,
+ * the cursor position is kept
  */
-void RgbLcdKeyShield::createCharP(uint8_t location, const uint8_t *charmap) {
-	location &= 0x7;   // we only have 8 memory locations 0-7
-	_lcdTransmit(setCgRamAdr | location << 3, true);
-	writeP(charmap, 8);
-	_lcdTransmit(setDdRamAdr, true);   // cursor position is lost
+void RgbLcdShield::createCharP(uint8_t location, const uint8_t *charmap) {
+	_uploadChar(location, charmap, true);
 }
 
 /*
  * Writes a string in program memory to the display making full
  * use of the wire transmit buffer.
  */
-size_t RgbLcdKeyShield::printP(const char str[]) {
+size_t RgbLcdShield::printP(const char str[]) {
 	/*
 	 * The Wire transmit buffer size is 32 bytes, for each character
 	 * Each character takes 4 bytes so a maximum of seven characters
@@ -440,13 +703,16 @@ size_t RgbLcdKeyShield::printP(const char str[]) {
 	size_t n = 0;
 	char c = pgm_read_byte(&str[n]);
 	while (c) {
+		size_t sent = n;
+		uint8_t count = 0;
 		Wire.beginTransmission(I2Caddr);
 		Wire.write(GPIOB);
 		do {
-			_lcdWrite8(c, false);
+			count += _textWrite(c, nullptr);
 			c = pgm_read_byte(&str[++n]);
-		} while (c && (n % 7));
-		Wire.endTransmission();
+		} while (c && count < 7);
+		if (_endLcdTransmission())
+			return sent;
 	};
 	return n;
 }
@@ -455,7 +721,7 @@ size_t RgbLcdKeyShield::printP(const char str[]) {
  * does the same as write(const uint8_t* buffer, size_t size)
  * but from program memory instead
  */
-size_t RgbLcdKeyShield::writeP(const uint8_t* buffer, size_t size) {
+size_t RgbLcdShield::writeP(const uint8_t* buffer, size_t size) {
 	/*
 	 * The Wire transmit buffer size is 32 bytes, for each character
 	 * Each character takes 4 bytes so a maximum of seven characters
@@ -463,12 +729,15 @@ size_t RgbLcdKeyShield::writeP(const uint8_t* buffer, size_t size) {
 	 */
 	size_t n = 0;
 	while (n < size) {
+		size_t sent = n;
 		Wire.beginTransmission(I2Caddr);
 		Wire.write(GPIOB);
 		do {
 			_lcdWrite8(pgm_read_byte(&buffer[n++]), false);
+			_stepAddress(_shadowEntryModeSet & left2RightFlag);
 		} while (n < size && (n % 7));
-		Wire.endTransmission();
+		if (_endLcdTransmission())
+			return sent;
 	}
 	return n;
 }
@@ -477,16 +746,29 @@ size_t RgbLcdKeyShield::writeP(const uint8_t* buffer, size_t size) {
 /*
  * Writes a character to the screen
  */
-size_t RgbLcdKeyShield::write(uint8_t c) {
-	_lcdTransmit(c, false);
-	return 1;
+size_t RgbLcdShield::write(uint8_t c) {
+	if ((c & 0x80) && _utf8Rom)
+		return write(&c, 1);
+	// ASCII ends an incomplete UTF-8 sequence
+	_utf8Pending = 0;
+	_stepAddress(_shadowEntryModeSet & left2RightFlag);
+	return _lcdTransmit(c, false) ? 0 : 1;
 }
 
 /*
  * Overrides the standard implementation to make full use of the
  * wire transmit buffer.
  */
-size_t RgbLcdKeyShield::write(const uint8_t* buffer, size_t size) {
+size_t RgbLcdShield::write(const uint8_t* buffer, size_t size) {
+	return write(buffer, size, nullptr);
+}
+
+/*
+ * Writes text like write(buffer, size) and passes the character code
+ * each character was mapped to, e.g. by utf8(), to the sink.
+ */
+size_t RgbLcdShield::write(const uint8_t *buffer, size_t size,
+		LcdTextSink *sink) {
 	/*
 	 * The Wire transmit buffer size is 32 bytes, for each character
 	 * Each character takes 4 bytes so a maximum of seven characters
@@ -494,35 +776,79 @@ size_t RgbLcdKeyShield::write(const uint8_t* buffer, size_t size) {
 	 */
 	size_t n = 0;
 	while (n < size) {
+		size_t sent = n;
+		uint8_t count = 0;
 		Wire.beginTransmission(I2Caddr);
 		Wire.write(GPIOB);
 		do {
-			_lcdWrite8(buffer[n++], false);
-		} while (n < size && (n % 7));
-		Wire.endTransmission();
+			count += _textWrite(buffer[n++], sink);
+		} while (n < size && count < 7);
+		if (_endLcdTransmission())
+			return sent;
+	}
+	return n;
+}
+
+/*
+ * Writes character codes at a position, the position is sent in the
+ * same transmission as the first characters. No UTF-8 decoding is done.
+ */
+size_t RgbLcdShield::writeAt(uint8_t col, uint8_t row, const uint8_t *buffer,
+		size_t size) {
+	size_t n = 0;
+	size_t sent = 0;
+	uint8_t count = 1;
+	_address = (col + row * 0x40) & 0x7f;
+	Wire.beginTransmission(I2Caddr);
+	Wire.write(GPIOB);
+	_lcdWrite8(setDdRamAdr | _address, true);
+	while (n < size) {
+		if (count == 7) {
+			if (_endLcdTransmission())
+				return sent;
+			sent = n;
+			Wire.beginTransmission(I2Caddr);
+			Wire.write(GPIOB);
+			count = 0;
+		}
+		_lcdWrite8(buffer[n++], false);
+		_stepAddress(_shadowEntryModeSet & left2RightFlag);
+		count++;
 	}
+	if (_endLcdTransmission())
+		return sent;
 	return n;
 }
 
 /*
  * Reads a character from the screen
  */
-uint8_t RgbLcdKeyShield::read() {
+uint8_t RgbLcdShield::read() {
 	uint8_t value;
+	uint16_t errors = _errorCount;
 	_prepareRead(false);
-	value =  _lcdRead8();
+	value =  _lcdRead8(errors);
 	_cleanupRead();
+	// reading moves the cursor like writing
+	if (errors == _errorCount)
+		_stepAddress(_shadowEntryModeSet & left2RightFlag);
 	return value;
 }
 
 /*
  * Reads multiple characters from the screen into a buffer
  */
-size_t RgbLcdKeyShield::read(uint8_t* buffer, size_t size) {
+size_t RgbLcdShield::read(uint8_t* buffer, size_t size) {
 	size_t n = 0;
+	uint16_t errors = _errorCount;
 	_prepareRead(false);
-	while (n < size) {
-		buffer[n++] = _lcdRead8();
+	// stop at a bus error as the display is resynchronized
+	while (n < size && errors == _errorCount) {
+		uint8_t value = _lcdRead8(errors);
+		if (errors == _errorCount) {
+			buffer[n++] = value;
+			_stepAddress(_shadowEntryModeSet & left2RightFlag);
+		}
 	}
 	_cleanupRead();
 	return n;
@@ -531,144 +857,1085 @@ size_t RgbLcdKeyShield::read(uint8_t* buffer, size_t size) {
 /*
  * Read the cursor position
  */
-uint8_t RgbLcdKeyShield::getCursor() {
+uint8_t RgbLcdShield::getCursor() {
 	uint8_t value;
+	uint16_t errors = _errorCount;
 	_prepareRead(true);
-	value = _lcdRead8();
+	value = _lcdRead8(errors);
 	_cleanupRead();
+	if (errors == _errorCount)
+		_address = value & 0x7f;
 	return value;
 }
 
 /*
- * Read the keys. To be placed in the main loop.
+ * Decode text written to the display as UTF-8 and map it to the character
+ * ROM of the display. Characters missing in the ROM are loaded on demand
+ * in the special character locations set in glyphLocations (bit 0 is
+ * location 0). A location is never replaced while its character may be on
+ * the display, when all are in use the base letter is shown instead.
+ * clear() frees the locations.
  */
-void RgbLcdKeyShield::readKeys() {
-	uint8_t keyState;
-	Wire.beginTransmission(I2Caddr);
-	Wire.write(GPIOA);
-	Wire.endTransmission();
-	Wire.requestFrom(I2Caddr, 1);
-	keyState = Wire.read();
-	keyLeft.read(keyState & B0010000);
-	keyUp.read(keyState & B0001000);
-	keyDown.read(keyState & B00000100);
-	keyRight.read(keyState & B00000010);
-	keySelect.read(keyState & B00000001);
+void RgbLcdShield::utf8(characterRoms rom, uint8_t glyphLocations) {
+	_utf8Rom = rom;
+	_utf8Pending = 0;
+	_glyphLocations = glyphLocations;
+	memset(_glyphIndex, noGlyph, sizeof(_glyphIndex));
 }
 
 /*
- * Clear all the callback pointers
+ * Write text as raw character codes
  */
-void RgbLcdKeyShield::clearKeys() {
-	keyLeft.clear();
-	keyUp.clear();
-	keyDown.clear();
-	keyRight.clear();
-	keySelect.clear();
+void RgbLcdShield::noUtf8() {
+	_utf8Rom = romNone;
 }
 
-// Private declarations--------------------------------------------
-
 /*
- * Helper function to write a value to a register of the MCP23017
+ * Sample the keys with repeated starts at the end of the first display
+ * transmission after each readKeyBits (and readKeys) call, so that the
+ * next call can skip its own read. The sample is used when it is not
+ * older than maxAge ms, keep this near the time between two calls as it
+ * is the latency this may add. Without display updates no sample is
+ * taken and the keys are read as before.
  */
-void RgbLcdKeyShield::_wireTransmit(uint8_t reg, uint8_t value) {
-	Wire.beginTransmission(I2Caddr);
-	Wire.write(reg);
-	Wire.write(value);
-	Wire.endTransmission();
+void RgbLcdShield::piggybackKeys(uint8_t maxAge) {
+	_keySample = keySamplePending;
+	_keySampleMaxAge = maxAge;
 }
 
 /*
- * Helper function to write a nibble to the display
+ * readKeyBits always reads the keys itself
  */
-void RgbLcdKeyShield::_lcdWrite4(uint8_t value, bool lcdInstruction) {
-	// clear the lcd bits of shadowB
-	_shadowGPIOB &= B00000001;
-	// Translate the least nibble only
-#ifdef __AVR__
-	_shadowGPIOB |= pgm_read_byte(&_nibbleToPin[value & B00001111]);
-#else
-	_shadowGPIOB |= _nibbleToPin[value & B00001111];
-#endif // __AVR__
-	// if the instruction register is addressed clear bit 7
-	if (lcdInstruction)
-		_shadowGPIOB &= B01111111;
-	// send the data
-	Wire.write(_shadowGPIOB);
-	// Toggle the enable bit
-	_shadowGPIOB ^= B00100000;
-	// and send again
-	Wire.write(_shadowGPIOB);
+void RgbLcdShield::noPiggybackKeys() {
+	_keySample = keySampleOff;
 }
 
 /*
- * Helper function to write a byte to the display
+ * Read the state of the keys, a bit is set when the key is pressed.
+ * See KeyPadHandler::keys for the bit positions.
  */
-void RgbLcdKeyShield::_lcdWrite8(uint8_t value, bool lcdInstruction) {
-	uint8_t temp = value;
-	_lcdWrite4(temp >> 4, lcdInstruction);
-	_lcdWrite4(value, lcdInstruction);
+uint8_t RgbLcdShield::readKeyBits() {
+	if (_keySample != keySampleOff) {
+		// use the sample taken along with a display update if recent enough
+		if (_keySample == keySampleFresh
+				&& (uint16_t) (millis() - _keySampleTime) <= _keySampleMaxAge) {
+			_keySample = keySamplePending;
+			return _keyBits;
+		}
+		_keySample = keySamplePending;
+	}
+	Wire.beginTransmission(I2Caddr);
+	Wire.write(GPIOA);
+	if (_endTransmission())
+		return 0;
+	if (Wire.requestFrom(I2Caddr, 1) != 1) {
+		_fault(busReadError);
+		return 0;
+	}
+	return Wire.read() & B00011111;
 }
 
+// Private declarations--------------------------------------------
+
 /*
- * Helper function to transmit a byte to the display
+ * Helper function to write a value to a register of the MCP23017
  */
-void RgbLcdKeyShield::_lcdTransmit(uint8_t value, bool lcdInstruction) {
-	Wire.beginTransmission(I2Caddr);
-	Wire.write(GPIOB);
-	_lcdWrite8(value, lcdInstruction);
-	Wire.endTransmission();
+uint8_t RgbLcdShield::_wireTransmit(uint8_t reg, uint8_t value) {
+	uint8_t status;
+	uint8_t attempt = 0;
+	// register writes can safely be repeated, a resync retries by itself
+	do {
+		Wire.beginTransmission(I2Caddr);
+		Wire.write(reg);
+		Wire.write(value);
+		status = Wire.endTransmission();
+	} while (status && !_resyncing && attempt++ < _retries);
+	if (status)
+		_fault(status);
+	return status;
 }
 
 /*
- * Helper function to prepare for a read
+ * Helper function to end a transmission and handle a failure
  */
-void RgbLcdKeyShield::_prepareRead(bool lcdInstruction) {
-	// set lcd data pins of GPIOB as input
-	_wireTransmit(IODIRB, B00011110);
-	// clear the lcd bits of shadowB
-	_shadowGPIOB &= B00000001;
-	if (lcdInstruction)	// set R/W high
-		_shadowGPIOB |= B01000000;
-	else // set RS, and R/W high
-		_shadowGPIOB |= B11000000;
-	_wireTransmit(GPIOB, _shadowGPIOB);
+uint8_t RgbLcdShield::_endTransmission() {
+	uint8_t status = Wire.endTransmission();
+	if (status)
+		_fault(status);
+	return status;
 }
 
 /*
- * Helper function to read a nibble from the display
+ * Helper function to end a display transmission, when a key sample is
+ * pending the keys are read with repeated starts before the bus is
+ * released. A sample is only pending after readKeyBits used the last one.
  */
-uint8_t RgbLcdKeyShield::_lcdRead4() {
-	uint8_t value = 0;
-	uint8_t temp;
-	// set enable high
-	_shadowGPIOB |= B00100000;
-	_wireTransmit(GPIOB, _shadowGPIOB);
-	Wire.requestFrom(I2Caddr, GPIOB, 1);
-	temp = Wire.read();
-	// clear enable
-	_shadowGPIOB &= B11000001;
-	_wireTransmit(GPIOB, _shadowGPIOB);
-	// translate pin to nibble
-	bitWrite(value, 0, bitRead(temp, 4));
-	bitWrite(value, 1, bitRead(temp, 3));
-	bitWrite(value, 2, bitRead(temp, 2));
-	bitWrite(value, 3, bitRead(temp, 1));
-	return value;
+uint8_t RgbLcdShield::_endLcdTransmission() {
+	if (_keySample != keySamplePending)
+		return _endTransmission();
+	uint8_t status = Wire.endTransmission(false);
+	if (!status) {
+		Wire.beginTransmission(I2Caddr);
+		Wire.write(GPIOA);
+		status = Wire.endTransmission(false);
+		if (!status) {
+			// the display data is sent, a failed read does not change that
+			if (Wire.requestFrom(I2Caddr, 1) == 1) {
+				_keyBits = Wire.read() & B00011111;
+				_keySample = keySampleFresh;
+				_keySampleTime = millis();
+			} else
+				_fault(busReadError);
+			return busOk;
+		}
+	}
+	_fault(status);
+	return status;
 }
 
 /*
- * Helper function to read a byte from the display
+ * Helper function to register a bus error and resynchronize, as the
+ * shadow registers and the nibble sync of the lcd can no longer be trusted
  */
-inline uint8_t RgbLcdKeyShield::_lcdRead8() {
-	return (_lcdRead4() << 4) + _lcdRead4();
+void RgbLcdShield::_fault(uint8_t error) {
+	_lastError = error;
+	_errorCount++;
+	if (!_resyncing)
+		resync();
 }
 
 /*
- * Helper function to cleanup after read
+ * Helper function to set up the MCP23017 and the 4 bit interface of the
+ * lcd from the shadow registers, returns true when no error occurred
  */
-inline void RgbLcdKeyShield::_cleanupRead() {
-	// set all pins back as output
-	_wireTransmit(IODIRB, B00000000);
+bool RgbLcdShield::_initialize() {
+	uint16_t errors = _errorCount;
+	/*
+	 * Set the MCP23017 in 8 bit mode , sequential addressing
+	 * disabled and slew rate disabled by writing to
+	 * register 0x0b.
+	 * As this register is not present in 16 bit mode
+	 * we can safely write to it after a hot reset
+	 * of the controlling device as in this case the
+	 * MCP23017 is already in 8 bit mode which is possible
+	 * as the hardware reset of the device is not used.
+	 */
+	_wireTransmit(IOCON, B10101000);
+	// end a possibly interrupted read with enable high and R/W low
+	_shadowGPIOB = (_shadowGPIOB & B00000001) | B00100000;
+	// set bit 6 (red led) and 7 (green led) from the shadow register
+	_wireTransmit(GPIOA, _shadowGPIOA);
+	// make bit 7 and 6 outputs
+	_wireTransmit(IODIRA, B00111111);
+	// enable pull-ups on input pins
+	_wireTransmit(GPPUA, B00111111);
+	// set bit 0 (blue led) from the shadow register and 5 (lcd enable) high
+	_wireTransmit(GPIOB, _shadowGPIOB);
+	// set all to output
+	_wireTransmit(IODIRB, B00000000);
+	// invert the 5 bits connected to the keys so that key pressed is high now
+	_wireTransmit(IPOLA, B00011111);
+
+	/* Initialize the lcd display
+	 * For an explanation what is going on see the Wikipedia
+	 * Hitachi HD44780 LCD controller entry
+	 */
+	Wire.beginTransmission(I2Caddr);
+	Wire.write(GPIOB);
+	_lcdWrite4(B0011, true);
+	_endTransmission();
+
+	delay(5);
+
+	Wire.beginTransmission(I2Caddr);
+	Wire.write(GPIOB);
+	_lcdWrite4(B0011, true);
+	_lcdWrite4(B0011, true);
+	// should be in 8 bit mode now so set to 4 bit mode
+	_lcdWrite4(B0010, true);
+	// set 2 lines and 5x8 dots
+	_lcdWrite8(functionSet | lineMode2Flag, true);
+	// set on, no cursor and no blinking
+	_lcdWrite8(_shadowDisplayControl, true);
+	// left to right, no shift
+	_lcdWrite8(_shadowEntryModeSet, true);
+	// restore the cursor
+	_lcdWrite8(setDdRamAdr | _address, true);
+	_endTransmission();
+	return errors == _errorCount;
+}
+
+/*
+ * Helper function to set the backlight leds through the shadow registers
+ */
+void RgbLcdShield::_writeColor(colors color) {
+	uint8_t _color;
+	_invertedBacklight ? _color =~ color : _color = color;
+	bitWrite(_shadowGPIOA, 6, !(_color & clRed));
+	bitWrite(_shadowGPIOA, 7, !(_color & clGreen));
+	bitWrite(_shadowGPIOB, 0, !(_color & clBlue));
+	_wireTransmit(GPIOA, _shadowGPIOA);
+	_wireTransmit(GPIOB, _shadowGPIOB);
+}
+
+/*
+ * Helper function to load a special character in two transmissions,
+ * the cursor address is restored from its shadow in the last one
+ */
+void RgbLcdShield::_uploadChar(uint8_t location, const uint8_t *charmap,
+		bool inProgmem) {
+	/*
+	 * The Wire transmit buffer size is 32 bytes, the address instruction
+	 * and six rows fit in the first transmission, the last two rows and
+	 * the cursor address in the second.
+	 */
+#ifndef __AVR__
+	(void) inProgmem;	// no program memory to read from
+#endif // __AVR__
+	location &= 0x7;   // we only have 8 memory locations 0-7
+	Wire.beginTransmission(I2Caddr);
+	Wire.write(GPIOB);
+	_lcdWrite8(setCgRamAdr | location << 3, true);
+	for (uint8_t row = 0; row < 8; ++row) {
+		if (row == 6) {
+			// do not write the remaining rows to an unknown address
+			if (_endTransmission())
+				return;
+			Wire.beginTransmission(I2Caddr);
+			Wire.write(GPIOB);
+		}
+#ifdef __AVR__
+		_lcdWrite8(inProgmem ? pgm_read_byte(&charmap[row]) : charmap[row],
+				false);
+#else
+		_lcdWrite8(charmap[row], false);
+#endif // __AVR__
+	}
+	_lcdWrite8(setDdRamAdr | _address, true);
+	_endLcdTransmission();
+}
+
+/*
+ * Helper function to write a nibble to the display
+ */
+void RgbLcdShield::_lcdWrite4(uint8_t value, bool lcdInstruction) {
+	// clear the lcd bits of shadowB
+	_shadowGPIOB &= B00000001;
+	// Translate the least nibble only
+#ifdef __AVR__
+	_shadowGPIOB |= pgm_read_byte(&_nibbleToPin[value & B00001111]);
+#else
+	_shadowGPIOB |= _nibbleToPin[value & B00001111];
+#endif // __AVR__
+	// if the instruction register is addressed clear bit 7
+	if (lcdInstruction)
+		_shadowGPIOB &= B01111111;
+	// send the data
+	Wire.write(_shadowGPIOB);
+	// Toggle the enable bit
+	_shadowGPIOB ^= B00100000;
+	// and send again
+	Wire.write(_shadowGPIOB);
+}
+
+/*
+ * Helper function to write a byte to the display
+ */
+void RgbLcdShield::_lcdWrite8(uint8_t value, bool lcdInstruction) {
+	uint8_t temp = value;
+	_lcdWrite4(temp >> 4, lcdInstruction);
+	_lcdWrite4(value, lcdInstruction);
+}
+
+/*
+ * Helper function to transmit a byte to the display
+ */
+uint8_t RgbLcdShield::_lcdTransmit(uint8_t value, bool lcdInstruction) {
+	Wire.beginTransmission(I2Caddr);
+	Wire.write(GPIOB);
+	_lcdWrite8(value, lcdInstruction);
+	return _endLcdTransmission();
+}
+
+/*
+ * Helper function to write a character of text inside a transmission,
+ * returns the number of characters added to the transmission
+ */
+uint8_t RgbLcdShield::_textWrite(uint8_t c, LcdTextSink *sink) {
+	// ASCII takes the fast path
+	if ((c & 0x80) && _utf8Rom) {
+		uint16_t code = _utf8Char(c);
+		if (code == utf8Incomplete)
+			return 0;
+		if (code & utf8Glyph) {
+			// loading the glyph needs the bus, continue in a new transmission
+			_endTransmission();
+			code = _loadGlyph(code);
+			Wire.beginTransmission(I2Caddr);
+			Wire.write(GPIOB);
+		}
+		c = code;
+	} else // ASCII ends an incomplete UTF-8 sequence
+		_utf8Pending = 0;
+	if (sink)
+		sink->put(c);
+	_lcdWrite8(c, false);
+	_stepAddress(_shadowEntryModeSet & left2RightFlag);
+	return 1;
+}
+
+/*
+ * Helper function to decode a byte of an UTF-8 sequence
+ */
+uint16_t RgbLcdShield::_utf8Char(uint8_t c) {
+	/*
+	 * The lower two bits of _utf8Pending hold the number of continuation
+	 * bytes to go, bit 7 marks a code point outside of the 16 bit range.
+	 */
+	if (c < 0xc0) {
+		// drop continuation bytes without a lead byte
+		if (!(_utf8Pending & 0x03))
+			return utf8Incomplete;
+		_utf8CodePoint = _utf8CodePoint << 6 | (c & 0x3f);
+		if (--_utf8Pending & 0x03)
+			return utf8Incomplete;
+		if (_utf8Pending) {
+			_utf8Pending = 0;
+			return '?';
+		}
+		return _utf8Map(_utf8CodePoint);
+	}
+	if (c < 0xe0) {
+		_utf8CodePoint = c & 0x1f;
+		_utf8Pending = 1;
+	} else if (c < 0xf0) {
+		_utf8CodePoint = c & 0x0f;
+		_utf8Pending = 2;
+	} else
+		_utf8Pending = 0x83;
+	return utf8Incomplete;
+}
+
+/*
+ * Helper function to map a code point to a character code, returns
+ * utf8Glyph plus the glyph index when the glyph is not loaded yet
+ */
+uint16_t RgbLcdShield::_utf8Map(uint16_t codePoint) {
+	int8_t low, high;
+	if (_utf8Rom == romA02 && codePoint >= 0xa0 && codePoint <= 0xff)
+		return codePoint;
+	if (_utf8Rom == romA00) {
+		low = 0;
+		high = sizeof(_romA00) / sizeof(romMapping) - 1;
+		while (low <= high) {
+			int8_t mid = (low + high) / 2;
+#ifdef __AVR__
+			uint16_t value = pgm_read_word(&_romA00[mid].codePoint);
+#else
+			uint16_t value = _romA00[mid].codePoint;
+#endif // __AVR__
+			if (value == codePoint)
+#ifdef __AVR__
+				return pgm_read_byte(&_romA00[mid].code);
+#else
+				return _romA00[mid].code;
+#endif // __AVR__
+			if (value < codePoint)
+				low = mid + 1;
+			else
+				high = mid - 1;
+		}
+	}
+	if (_glyphLocations) {
+		low = 0;
+		high = sizeof(_glyphs) / sizeof(glyph) - 1;
+		while (low <= high) {
+			int8_t mid = (low + high) / 2;
+#ifdef __AVR__
+			uint16_t value = pgm_read_word(&_glyphs[mid].codePoint);
+#else
+			uint16_t value = _glyphs[mid].codePoint;
+#endif // __AVR__
+			if (value == codePoint) {
+				bool free = false;
+				for (uint8_t location = 0; location < 8; ++location) {
+					if (_glyphIndex[location] == mid)
+						return location;
+					if (bitRead(_glyphLocations, location)
+							&& _glyphIndex[location] == noGlyph)
+						free = true;
+				}
+				if (free)
+					return utf8Glyph | mid;
+#ifdef __AVR__
+				return pgm_read_byte(&_glyphs[mid].base);
+#else
+				return _glyphs[mid].base;
+#endif // __AVR__
+			}
+			if (value < codePoint)
+				low = mid + 1;
+			else
+				high = mid - 1;
+		}
+	}
+	return '?';
+}
+
+/*
+ * Helper function to load a glyph in a free special character location,
+ * returns the location. _utf8Map made sure there is one.
+ */
+uint8_t RgbLcdShield::_loadGlyph(uint8_t index) {
+	uint8_t location = 0;
+	while (!bitRead(_glyphLocations, location)
+			|| _glyphIndex[location] != noGlyph)
+		location++;
+#ifdef __AVR__
+	createCharP(location, _glyphs[index].charmap);
+#else
+	createChar(location, _glyphs[index].charmap);
+#endif // __AVR__
+	_glyphIndex[location] = index;
+	return location;
+}
+
+/*
+ * Helper function to move the shadow of the address counter one position,
+ * in two line mode the lines are 0x00 - 0x27 and 0x40 - 0x67
+ */
+void RgbLcdShield::_stepAddress(bool right) {
+	if (right)
+		_address = _address == 0x27 ? 0x40 : _address == 0x67 ? 0x00 : _address + 1;
+	else
+		_address = _address == 0x40 ? 0x27 : _address == 0x00 ? 0x67 : _address - 1;
+}
+
+/*
+ * Helper function to prepare for a read
+ */
+void RgbLcdShield::_prepareRead(bool lcdInstruction) {
+	// set lcd data pins of GPIOB as input
+	_wireTransmit(IODIRB, B00011110);
+	// clear the lcd bits of shadowB
+	_shadowGPIOB &= B00000001;
+	if (lcdInstruction)	// set R/W high
+		_shadowGPIOB |= B01000000;
+	else // set RS, and R/W high
+		_shadowGPIOB |= B11000000;
+	_wireTransmit(GPIOB, _shadowGPIOB);
+}
+
+/*
+ * Helper function to read a nibble from the display, nothing is done
+ * when the error count differs from errors. After a bus error the display
+ * is resynchronized and any enable pulse would write to it.
+ */
+uint8_t RgbLcdShield::_lcdRead4(uint16_t errors) {
+	uint8_t value = 0;
+	uint8_t temp;
+	if (errors != _errorCount)
+		return 0;
+	// set enable high
+	_shadowGPIOB |= B00100000;
+	if (_wireTransmit(GPIOB, _shadowGPIOB))
+		return 0;
+	if (Wire.requestFrom(I2Caddr, 1) != 1) {
+		_fault(busReadError);
+		return 0;
+	}
+	temp = Wire.read();
+	// clear enable
+	_shadowGPIOB &= B11000001;
+	_wireTransmit(GPIOB, _shadowGPIOB);
+	// translate pin to nibble
+	bitWrite(value, 0, bitRead(temp, 4));
+	bitWrite(value, 1, bitRead(temp, 3));
+	bitWrite(value, 2, bitRead(temp, 2));
+	bitWrite(value, 3, bitRead(temp, 1));
+	return value;
+}
+
+/*
+ * Helper function to read a byte from the display, stops when the
+ * error count differs from errors
+ */
+inline uint8_t RgbLcdShield::_lcdRead8(uint16_t errors) {
+	// the high nibble comes first
+	uint8_t value = _lcdRead4(errors) << 4;
+	return value + _lcdRead4(errors);
+}
+
+/*
+ * Helper function to cleanup after read
+ */
+inline void RgbLcdShield::_cleanupRead() {
+	// set all pins back as output
+	_wireTransmit(IODIRB, B00000000);
+}
+
+//--------------------------------RgbLcdKeyShield----------------------------
+
+RgbLcdKeyShield::RgbLcdKeyShield(bool invertedBacklight) :
+		RgbLcdShield(invertedBacklight) {
+	_idleState = idleAwake;
+	_backlightTimeout = 0;
+	_displayTimeout = 0;
+	_lastActivity = 0;
+	_lastScan = 0;
+	_idleScanInterval = 0;
+	_swallowKeys = false;
+	_wakePress = false;
+	_wakePressStart = 0;
+}
+
+/*
+ * Read the keys. To be placed in the main loop.
+ * When idle the keys are read at the idle scan interval and the
+ * first key press only wakes the display.
+ */
+void RgbLcdKeyShield::readKeys() {
+	uint32_t now = millis();
+	if (_idleState != idleAwake) {
+		if (now - _lastScan < _idleScanInterval)
+			return;
+		_lastScan = now;
+		// wake on a key held for idleDebounce ms, a glitch does not wake
+		if (!readKeyBits())
+			_wakePress = false;
+		else if (!_wakePress) {
+			_wakePress = true;
+			_wakePressStart = now;
+		} else if (now - _wakePressStart >= idleDebounce) {
+			_wakePress = false;
+			wake();
+			_swallowKeys = true;
+		}
+		return;
+	}
+	uint8_t keyState = readKeyBits();
+	// keep the keys released until the waking key press is released
+	if (_swallowKeys) {
+		if (keyState)
+			keyState = 0;
+		else
+			_swallowKeys = false;
+	}
+	keyLeft.read(keyState & B0010000, now);
+	keyUp.read(keyState & B0001000, now);
+	keyDown.read(keyState & B00000100, now);
+	keyRight.read(keyState & B00000010, now);
+	keySelect.read(keyState & B00000001, now);
+	// only a debounced key press counts as activity
+	if (keyLeft.isPressed() || keyUp.isPressed() || keyDown.isPressed()
+			|| keyRight.isPressed() || keySelect.isPressed()) {
+		_lastActivity = now;
+		return;
+	}
+	if (!(_idleState & idleBacklightOff) && _backlightTimeout
+			&& now - _lastActivity >= _backlightTimeout) {
+		noBacklight();
+		_idleState |= idleBacklightOff;
+	}
+	if (!(_idleState & idleDisplayOff) && _displayTimeout
+			&& now - _lastActivity >= _displayTimeout) {
+		noDisplay();
+		_idleState |= idleDisplayOff;
+	}
+}
+
+/*
+ * Clear all the callback pointers
+ */
+void RgbLcdKeyShield::clearKeys() {
+	keyLeft.clear();
+	keyUp.clear();
+	keyDown.clear();
+	keyRight.clear();
+	keySelect.clear();
+}
+
+/*
+ * Sets the time without key activity after which the backlight and
+ * the display are turned off (0 is never) and the interval the keys
+ * are read when idle. All times in ms. A key held for idleDebounce ms
+ * wakes the display, keep the interval well below the shortest key tap
+ * minus idleDebounce so that no tap is missed.
+ */
+void RgbLcdKeyShield::setIdleTimeouts(uint32_t backlightTimeout,
+		uint32_t displayTimeout, uint16_t idleScanInterval) {
+	_backlightTimeout = backlightTimeout;
+	_displayTimeout = displayTimeout;
+	_idleScanInterval = idleScanInterval;
+	_lastActivity = millis();
+}
+
+/*
+ * Turns the backlight and display back on if turned off when idle
+ * and restarts the idle timeouts.
+ */
+void RgbLcdKeyShield::wake() {
+	if (_idleState & idleBacklightOff)
+		backlight();
+	if (_idleState & idleDisplayOff)
+		display();
+	_idleState = idleAwake;
+	_lastActivity = millis();
+}
+
+/*
+ * Checks if the backlight or display was turned off when idle
+ */
+bool RgbLcdKeyShield::isIdle() {
+	return _idleState != idleAwake;
+}
+
+//--------------------------------CgramAnimator------------------------------
+
+CgramAnimator::CgramAnimator(RgbLcdShield &lcd) :
+		_lcd(lcd) {
+	stopAll();
+	_skipped = 0;
+}
+
+/*
+ * Animates a special character location with frameCount charmaps of
+ * 8 bytes in program memory, the interval is in ms. The first frame is
+ * loaded immediately. Returns false when all animations are in use.
+ */
+bool CgramAnimator::start(uint8_t location, const uint8_t *frames,
+		uint8_t frameCount, uint16_t interval) {
+	location &= 0x7;
+	stop(location);
+	for (uint8_t n = 0; n < maxAnimations; ++n) {
+		animation &anim = _animations[n];
+		if (anim.location == noLocation) {
+			anim.location = location;
+			anim.frames = frames;
+			anim.frameCount = max(frameCount, 1);
+			anim.interval = max(interval, 1);
+			anim.frame = 0;
+			anim.nextFrame = millis() + anim.interval;
+			_load(anim);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Stops the animation of a special character location,
+ * the current frame stays.
+ */
+void CgramAnimator::stop(uint8_t location) {
+	for (uint8_t n = 0; n < maxAnimations; ++n)
+		if (_animations[n].location == (location & 0x7))
+			_animations[n].location = noLocation;
+}
+
+/*
+ * Stops all animations
+ */
+void CgramAnimator::stopAll() {
+	for (uint8_t n = 0; n < maxAnimations; ++n)
+		_animations[n].location = noLocation;
+}
+
+/*
+ * To be placed in the main loop. Loads the frames that are due, when
+ * called too late the frames missed are skipped instead of played.
+ * The cursor position is kept.
+ */
+void CgramAnimator::service() {
+	uint32_t now = millis();
+	for (uint8_t n = 0; n < maxAnimations; ++n) {
+		animation &anim = _animations[n];
+		if (anim.location == noLocation
+				|| (int32_t) (now - anim.nextFrame) < 0)
+			continue;
+		uint32_t steps = (now - anim.nextFrame) / anim.interval + 1;
+		_skipped += steps - 1;
+		anim.nextFrame += steps * anim.interval;
+		anim.frame = (anim.frame + steps) % anim.frameCount;
+		_load(anim);
+	}
+}
+
+/*
+ * Number of frames skipped because service was called too late
+ */
+uint16_t CgramAnimator::getSkipped() {
+	return _skipped;
+}
+
+/*
+ * Helper function to load the current frame
+ */
+void CgramAnimator::_load(animation &anim) {
+#ifdef __AVR__
+	_lcd.createCharP(anim.location, &anim.frames[anim.frame * 8]);
+#else
+	_lcd.createChar(anim.location, &anim.frames[anim.frame * 8]);
+#endif // __AVR__
+}
+
+//--------------------------------LcdConsole---------------------------------
+
+LcdConsole::LcdConsole(RgbLcdShield &lcd) :
+		_lcd(lcd) {
+	memset(_ring, ' ', sizeof(_ring));
+	_newest = 0;
+	_lines = 1;
+	_col = 0;
+	_row = 0;
+	_view = 0;
+}
+
+/*
+ * Clears the display and the recent lines
+ */
+void LcdConsole::clear() {
+	_lcd.clear();
+	memset(_ring, ' ', sizeof(_ring));
+	_newest = 0;
+	_lines = 1;
+	_col = 0;
+	_row = 0;
+	_view = 0;
+}
+
+/*
+ * Writes a character to the console
+ */
+size_t LcdConsole::write(uint8_t c) {
+	return write(&c, 1);
+}
+
+/*
+ * Writes characters to the console, the characters of a line are sent
+ * in one go. Returns to the last lines when scrolled back.
+ */
+size_t LcdConsole::write(const uint8_t *buffer, size_t size) {
+	if (_view)
+		scrollBack(0);
+	// first column not yet sent to the display
+	uint8_t start = _col;
+	for (size_t n = 0; n < size; ++n) {
+		uint8_t c = buffer[n];
+		switch (c) {
+		case '\n':
+			_flush(start);
+			_newLine();
+			start = 0;
+			break;
+		case '\r':
+			_flush(start);
+			_col = 0;
+			start = 0;
+			break;
+		case '\t':
+			do {
+				_put(' ', start);
+			} while (_col % tabSize);
+			break;
+		default:
+			_put(c, start);
+		}
+	}
+	_flush(start);
+	return size;
+}
+
+/*
+ * Shows the lines that many lines back, 0 shows the last lines
+ */
+void LcdConsole::scrollBack(uint8_t lines) {
+	uint8_t oldTop = _top();
+	// only when the display is full there are lines to scroll back to
+	uint8_t maxView = _lines > rows ? _lines - rows : 0;
+	_view = min(lines, maxView);
+	_redraw(oldTop);
+}
+
+/*
+ * Helper function returning the ring index of the line on the top row
+ */
+uint8_t LcdConsole::_top() {
+	return (_newest + 2 * ringLines - _row - _view) % ringLines;
+}
+
+/*
+ * Helper function to put a character in the current line,
+ * wraps to a new line at the end of the line
+ */
+void LcdConsole::_put(uint8_t c, uint8_t &start) {
+	if (_col == columns) {
+		_flush(start);
+		_newLine();
+		start = 0;
+	}
+	_ring[_newest][_col++] = c;
+}
+
+/*
+ * Helper function to send the characters of the current line
+ * from start up to the cursor to the display
+ */
+void LcdConsole::_flush(uint8_t start) {
+	if (_col > start)
+		_lcd.writeAt(start, _row, &_ring[_newest][start], _col - start);
+}
+
+/*
+ * Helper function to start a new line, scrolls up when on the last row
+ */
+void LcdConsole::_newLine() {
+	uint8_t oldTop = _top();
+	_newest = (_newest + 1) % ringLines;
+	memset(_ring[_newest], ' ', columns);
+	_col = 0;
+	if (_lines < ringLines)
+		_lines++;
+	if (_row < rows - 1)
+		// the next row is still empty
+		_row++;
+	else
+		_redraw(oldTop);
+}
+
+/*
+ * Helper function to update the display from the lines shown at oldTop
+ * to the lines shown now
+ */
+void LcdConsole::_redraw(uint8_t oldTop) {
+	uint8_t newTop = _top();
+	if (newTop == oldTop)
+		return;
+	for (uint8_t row = 0; row < rows; ++row)
+		_redrawRow(row, _ring[(oldTop + row) % ringLines],
+				_ring[(newTop + row) % ringLines]);
+}
+
+/*
+ * Helper function to rewrite the characters of a row that differ
+ */
+void LcdConsole::_redrawRow(uint8_t row, const uint8_t *oldLine,
+		const uint8_t *newLine) {
+	uint8_t col = 0;
+	while (col < columns) {
+		if (oldLine[col] == newLine[col]) {
+			col++;
+			continue;
+		}
+		/*
+		 * Extend the run over single equal characters as rewriting one
+		 * character costs the same as setting a new position.
+		 */
+		uint8_t end = col + 1;
+		while (end < columns) {
+			if (oldLine[end] != newLine[end])
+				end++;
+			else if (end + 1 < columns && oldLine[end + 1] != newLine[end + 1])
+				end += 2;
+			else
+				break;
+		}
+		_lcd.writeAt(col, row, &newLine[col], end - col);
+		col = end;
+	}
+}
+
+//--------------------------------LcdScrubber--------------------------------
+
+LcdScrubber::LcdScrubber(RgbLcdShield &lcd) :
+		_lcd(lcd) {
+	memset(_cells, ' ', cells);
+	memset(_charmap, 0, sizeof(_charmap));
+	_charmapInProgmem = 0;
+	_col = 0;
+	_row = 0;
+	_next = 0;
+	_cellsPerTick = 4;
+	clearCounters();
+}
+
+/*
+ * Clears the display and the intended contents
+ */
+void LcdScrubber::clear() {
+	_lcd.clear();
+	memset(_cells, ' ', cells);
+	_col = 0;
+	_row = 0;
+}
+
+/*
+ * Sets the position of the cursor at which subsequent characters
+ * will appear.
+ */
+void LcdScrubber::setCursor(uint8_t col, uint8_t row) {
+	_col = col;
+	_row = row;
+	_lcd.setCursor(col, row);
+}
+
+/*
+ * Loads a special character and keeps a pointer to it for verification.
+ * The cursor position is kept.
+ */
+void LcdScrubber::createChar(uint8_t location, const uint8_t *charmap) {
+	location &= 0x7;
+	_charmap[location] = charmap;
+	bitClear(_charmapInProgmem, location);
+	_lcd.createChar(location, charmap);
+}
+
+#ifdef __AVR__
+/*
+ * Loads a special character from program memory and keeps a pointer
+ * to it for verification. The cursor position is kept.
+ */
+void LcdScrubber::createCharP(uint8_t location, const uint8_t *charmap) {
+	location &= 0x7;
+	_charmap[location] = charmap;
+	bitSet(_charmapInProgmem, location);
+	_lcd.createCharP(location, charmap);
+}
+#endif // __AVR__
+
+/*
+ * Writes a character to the screen and the intended contents
+ */
+size_t LcdScrubber::write(uint8_t c) {
+	return write(&c, 1);
+}
+
+/*
+ * Writes multiple characters making full use of the wire transmit buffer,
+ * the character codes sent to the display are kept as intended contents
+ */
+size_t LcdScrubber::write(const uint8_t *buffer, size_t size) {
+	return _lcd.write(buffer, size, this);
+}
+
+/*
+ * To be placed in the main loop. Verifies the next few cells and
+ * rewrites the ones that do not match the intended contents.
+ * A special character counts as eight cells.
+ */
+void LcdScrubber::service() {
+	uint8_t budget = _cellsPerTick;
+	while (budget) {
+		if (_next < cells)
+			budget -= _scrubCells(budget);
+		else {
+			uint8_t location = _next - cells;
+			if (_charmap[location]) {
+				// do not exceed the budget unless nothing else was done
+				if (budget < cgramRows && budget != _cellsPerTick)
+					break;
+				_scrubCharmap(location);
+				budget -= min(budget, (uint8_t) cgramRows);
+			}
+			if (++_next == cells + cgramLocations)
+				_next = 0;
+		}
+	}
+	// continue where the application left off
+	_lcd.setCursor(_col, _row);
+}
+
+/*
+ * Sets the maximum number of cells verified per service call
+ */
+void LcdScrubber::setCellsPerTick(uint8_t cells) {
+	_cellsPerTick = max(cells, 1);
+}
+
+/*
+ * Number of corrupted cells found
+ */
+uint16_t LcdScrubber::getDetected() {
+	return _detected;
+}
+
+/*
+ * Number of corrupted cells that were verified correct after rewriting
+ */
+uint16_t LcdScrubber::getRepaired() {
+	return _repaired;
+}
+
+/*
+ * Resets the detected and repaired counters
+ */
+void LcdScrubber::clearCounters() {
+	_detected = 0;
+	_repaired = 0;
+}
+
+/*
+ * Helper function to keep a character code written as intended contents
+ */
+void LcdScrubber::put(uint8_t code) {
+	if (_col < columns && _row < rows)
+		_cells[_row * columns + _col] = code;
+	// stay off the display however long the text is
+	if (_col < 0xff)
+		_col++;
+}
+
+/*
+ * Helper function to verify and repair cells on the same row,
+ * returns the number of cells verified
+ */
+uint8_t LcdScrubber::_scrubCells(uint8_t budget) {
+	uint8_t actual[columns];
+	uint8_t col = _next % columns;
+	uint8_t row = _next / columns;
+	uint8_t size = min(budget, columns - col);
+	_lcd.setCursor(col, row);
+	// only compare what was read without a bus error
+	uint8_t count = _lcd.read(actual, size);
+	for (uint8_t n = 0; n < count; ++n) {
+		uint8_t c = _cells[_next + n];
+		if (actual[n] != c) {
+			_detected++;
+			// a raw character code, not decoded as UTF-8 again
+			_lcd.writeAt(col + n, row, &c, 1);
+			_lcd.setCursor(col + n, row);
+			if (_lcd.read() == c)
+				_repaired++;
+		}
+	}
+	_next += size;
+	return size;
+}
+
+/*
+ * Helper function to verify and repair a special character
+ */
+void LcdScrubber::_scrubCharmap(uint8_t location) {
+	uint8_t actual[cgramRows];
+	uint8_t intended[cgramRows];
+#ifdef __AVR__
+	if (bitRead(_charmapInProgmem, location))
+		memcpy_P(intended, _charmap[location], cgramRows);
+	else
+#endif // __AVR__
+		memcpy(intended, _charmap[location], cgramRows);
+	_lcd.readChar(location, actual);
+	// only the lower five bits are pixels
+	for (uint8_t n = 0; n < cgramRows; ++n) {
+		if ((actual[n] ^ intended[n]) & B00011111) {
+			_detected++;
+			_lcd.createChar(location, intended);
+			_lcd.readChar(location, actual);
+			for (n = 0; n < cgramRows; ++n)
+				if ((actual[n] ^ intended[n]) & B00011111)
+					return;
+			_repaired++;
+			return;
+		}
+	}
 }
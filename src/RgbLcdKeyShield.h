@@ -32,6 +32,15 @@
  * 0.0.5	2017/06/27 updated version
  * 0.0.6	2017/07/25 introduced read and getCursor for the lcd
  * 0.0.7	2021/03/08 introduced inverted backlight option
+ * 0.0.8	2026/10/18 introduced KeyPadHandler and the key-less RgbLcdShield base
+ * 0.0.9	2026/10/18 introduced readChar and LcdScrubber
+ * 0.1.0	2026/10/18 introduced UTF-8 text output
+ * 0.1.1	2026/10/18 introduced backlight, noBacklight and idle timeouts
+ * 0.1.2	2026/10/18 SimpleKeyHandler read with time argument, wraparound safe
+ * 0.1.3	2026/10/18 createChar(P) restores a cursor address, introduced CgramAnimator
+ * 0.1.4	2026/10/18 introduced writeAt and LcdConsole
+ * 0.1.5	2026/10/18 bus error detection, retries, bus timeout and resync
+ * 0.1.6	2026/10/18 introduced key sampling along with display updates
  */
 
 #ifndef RgbLcdKeyShield_H
@@ -44,6 +53,7 @@ class SimpleKeyHandler {
 public:
 	SimpleKeyHandler();
 	void read(bool keyState);
+	void read(bool keyState, uint32_t now);
 	void clear();
 	bool isPressed();
 	// Called when the key is released before the long press time expired.
@@ -72,9 +82,69 @@ private:
 	static SimpleKeyHandler* _otherKey;
 };
 
-class RgbLcdKeyShield: public Print {
+/*
+ * Handles all five keys in one pass over the GPIOA byte. Timing is done
+ * with 16 bit time stamps (wraparound safe) from one time sample per scan.
+ */
+class KeyPadHandler {
 public:
-	enum colors uint8_t {
+	// bit positions of the keys as returned by RgbLcdShield::readKeyBits
+	enum keys : uint8_t {
+		keySelect, keyRight, keyDown, keyUp, keyLeft, keyCount
+	};
+	enum keyEvents : uint8_t {
+		evShortPress, evLongPress, evRepPress
+	};
+	KeyPadHandler();
+	void scan(uint8_t keyBits, uint32_t now);
+	void setTiming(uint8_t key, uint8_t debounceTime, uint16_t longPressTime,
+			uint16_t repeatTime);
+	void clear();
+	bool isPressed(uint8_t key);
+	uint8_t pressedKeys();
+	// Called for the first key pressed, count is the repeat count for evRepPress
+	void (*onKeyEvent)(uint8_t key, keyEvents event, uint16_t count);
+	// Called when all keys of a chord (two or more keys pressed together) are released
+	void (*onChord)(uint8_t keyMask);
+private:
+	enum keyTime {
+		tick = 10,	// unit of the long press and repeat times
+		debounce = 50,
+		longPress = 500,
+		repeatInterval = 250
+	};
+	enum {
+		allKeys = B00011111,
+		noKey = 0xff
+	};
+	// debounce in ms, long press and repeat interval in ticks
+	struct keyTiming {
+		uint8_t debounce;
+		uint8_t longPress;
+		uint8_t repeatInterval;
+	} _timing[keyCount];
+	uint16_t _edge[keyCount];	// time stamp of the last level change
+	uint16_t _nextEvent;		// time stamp of the next long or repeat press
+	uint16_t _count;
+	uint8_t _raw;				// key bits of the previous scan
+	uint8_t _stable;			// debounced key bits
+	uint8_t _chord;				// keys pressed while the active key was down
+	uint8_t _activeKey;
+	void _pressed(uint8_t key, uint16_t time);
+	void _released(uint8_t key);
+};
+
+/*
+ * Receives the character codes text written to the display was mapped to
+ */
+class LcdTextSink {
+public:
+	virtual void put(uint8_t code) = 0;
+};
+
+class RgbLcdShield: public Print {
+public:
+	enum colors : uint8_t {
 		clBlack = 0,
 		clRed = 1,
 		clGreen = 2,
@@ -85,15 +155,38 @@ public:
 		clWhite = 7
 	};
 
+	// errors as returned by Wire.endTransmission plus busReadError
+	enum busErrors : uint8_t {
+		busOk = 0,
+		busDataTooLong = 1,
+		busAddressNack = 2,
+		busDataNack = 3,
+		busOther = 4,
+		busTimeout = 5,
+		busReadError = 6
+	};
+
+	// character ROM of the HD44780 used to map UTF-8 text
+	enum characterRoms : uint8_t {
+		romNone, romA00, romA02
+	};
+
 	using Print::write; // pull in write(str) and write(buf, size) from Print
 
-	RgbLcdKeyShieldI2C(bool invertedBacklight = false);
+	RgbLcdShield(bool invertedBacklight = false);
 
 	void begin(void);
+	bool resync();
+	void setRetries(uint8_t retries);
+	void setBusTimeout(uint16_t timeout);
+	uint8_t getLastError();
+	uint16_t getErrorCount();
 	void clear();
 	void home();
 	void setCursor(uint8_t col, uint8_t row);
 	void setColor(colors color);
+	void backlight();
+	void noBacklight();
 	void display();
 	void noDisplay();
 	void blink();
@@ -109,6 +202,7 @@ public:
 	void autoscroll();
 	void noAutoscroll();
 	void createChar(uint8_t location, const uint8_t *charmap);
+	void readChar(uint8_t location, uint8_t *charmap);
 #ifdef __AVR__
 	void createCharP(uint8_t location, const uint8_t *charmap);
 	size_t printP(const char str[]);
@@ -116,17 +210,18 @@ public:
 #endif // __AVR__
 	virtual size_t write(uint8_t c);
 	size_t write(const uint8_t *buffer, size_t size) override;
+	size_t write(const uint8_t *buffer, size_t size, LcdTextSink *sink);
+	size_t writeAt(uint8_t col, uint8_t row, const uint8_t *buffer,
+			size_t size);
 	uint8_t read();
 	size_t read(uint8_t *buffer, size_t size);
 	uint8_t getCursor();
+	void utf8(characterRoms rom = romA00, uint8_t glyphLocations = B11110000);
+	void noUtf8();
 
-	void readKeys();
-	void clearKeys();
-	SimpleKeyHandler keyLeft;
-	SimpleKeyHandler keyRight;
-	SimpleKeyHandler keyUp;
-	SimpleKeyHandler keyDown;
-	SimpleKeyHandler keySelect;
+	uint8_t readKeyBits();
+	void piggybackKeys(uint8_t maxAge = 10);
+	void noPiggybackKeys();
 private:
 	// 8 bit mode MCP23017 register addresses
 	enum MCP23017 {
@@ -175,19 +270,233 @@ private:
 	uint8_t _shadowDisplayControl;
 	uint8_t _shadowEntryModeSet;
 
+	// shadow of the HD44780 DDRAM address counter, the cursor position
+	uint8_t _address;
+
 	// translation table from nibble to pin
 	static const uint8_t _nibbleToPin[16];
 	
 	bool _invertedBacklight;
+	colors _color;
+	bool _backlightOn;
+
+	// bus error handling
+	uint16_t _busTimeout;	// us
+	uint8_t _retries;
+	uint8_t _lastError;
+	uint16_t _errorCount;
+	bool _resyncing;
+
+	// key sample taken along with a display update
+	enum keySamples : uint8_t {
+		keySampleOff, keySamplePending, keySampleFresh
+	};
+	uint8_t _keySample;
+	uint8_t _keyBits;
+	uint8_t _keySampleMaxAge;	// ms
+	uint16_t _keySampleTime;
 
-	void _wireTransmit(uint8_t reg, uint8_t value);
+	// code point to character ROM and code point to special character tables
+	struct romMapping {
+		uint16_t codePoint;
+		uint8_t code;
+	};
+	struct glyph {
+		uint16_t codePoint;
+		uint8_t base;	// shown when no special character location is free
+		uint8_t charmap[8];
+	};
+	static const romMapping _romA00[25];
+	static const glyph _glyphs[38];
+	enum utf8Results {
+		utf8Incomplete = 0x100,	// no character to write yet
+		utf8Glyph = 0x200		// special character must be loaded first
+	};
+
+	// UTF-8 decoder state and the special characters in use
+	uint8_t _utf8Rom;
+	uint8_t _utf8Pending;
+	uint16_t _utf8CodePoint;
+	enum {
+		noGlyph = 0xff
+	};
+	uint8_t _glyphLocations;
+	uint8_t _glyphIndex[8];	// glyph loaded in each location or noGlyph
+
+	uint8_t _wireTransmit(uint8_t reg, uint8_t value);
+	uint8_t _endTransmission();
+	uint8_t _endLcdTransmission();
+	void _fault(uint8_t error);
+	bool _initialize();
+	void _writeColor(colors color);
+	void _uploadChar(uint8_t location, const uint8_t *charmap,
+			bool inProgmem);
+	void _stepAddress(bool right);
 	void _lcdWrite4(uint8_t value, bool lcdInstruction);
 	void _lcdWrite8(uint8_t value, bool lcdInstruction);
-	void _lcdTransmit(uint8_t value, bool lcdInstruction);
+	uint8_t _lcdTransmit(uint8_t value, bool lcdInstruction);
 	void _prepareRead(bool lcdInstruction);
-	uint8_t _lcdRead4();
-	inline uint8_t _lcdRead8();
+	uint8_t _lcdRead4(uint16_t errors);
+	inline uint8_t _lcdRead8(uint16_t errors);
 	inline void _cleanupRead();
+	uint8_t _textWrite(uint8_t c, LcdTextSink *sink);
+	uint16_t _utf8Char(uint8_t c);
+	uint16_t _utf8Map(uint16_t codePoint);
+	uint8_t _loadGlyph(uint8_t index);
+};
+
+class RgbLcdKeyShield: public RgbLcdShield {
+public:
+	RgbLcdKeyShield(bool invertedBacklight = false);
+
+	void readKeys();
+	void clearKeys();
+	void setIdleTimeouts(uint32_t backlightTimeout, uint32_t displayTimeout,
+			uint16_t idleScanInterval = 10);
+	void wake();
+	bool isIdle();
+	SimpleKeyHandler keyLeft;
+	SimpleKeyHandler keyRight;
+	SimpleKeyHandler keyUp;
+	SimpleKeyHandler keyDown;
+	SimpleKeyHandler keySelect;
+private:
+	// bit mask of what was turned off when idle
+	enum idleStates : uint8_t {
+		idleAwake = 0, idleBacklightOff = 1, idleDisplayOff = 2
+	};
+	uint8_t _idleState;
+	// timeouts in ms, 0 is never
+	uint32_t _backlightTimeout;
+	uint32_t _displayTimeout;
+	uint32_t _lastActivity;
+	uint32_t _lastScan;
+	uint16_t _idleScanInterval;
+	bool _swallowKeys;
+	// a key press while idle, it wakes once held for idleDebounce ms
+	enum {
+		idleDebounce = 30
+	};
+	bool _wakePress;
+	uint32_t _wakePressStart;
+};
+
+/*
+ * Animates special characters by loading the next frame from program
+ * memory at a fixed interval. Every cell showing the special character
+ * changes at once without rewriting the display contents.
+ */
+class CgramAnimator {
+public:
+	CgramAnimator(RgbLcdShield &lcd);
+	bool start(uint8_t location, const uint8_t *frames, uint8_t frameCount,
+			uint16_t interval);
+	void stop(uint8_t location);
+	void stopAll();
+	void service();
+	uint16_t getSkipped();
+private:
+	enum {
+		maxAnimations = 4,
+		noLocation = 0xff
+	};
+	struct animation {
+		const uint8_t *frames;	// frameCount charmaps of 8 bytes
+		uint32_t nextFrame;
+		uint16_t interval;
+		uint8_t location;
+		uint8_t frameCount;
+		uint8_t frame;
+	} _animations[maxAnimations];
+	RgbLcdShield &_lcd;
+	uint16_t _skipped;
+	void _load(animation &anim);
+};
+
+/*
+ * A scrolling console with line wrap, carriage return and tab stops.
+ * Keeps a few recent lines that can be scrolled back to. When scrolling
+ * only the characters that differ are rewritten.
+ */
+class LcdConsole: public Print {
+public:
+	using Print::write; // pull in write(str) and write(buf, size) from Print
+
+	LcdConsole(RgbLcdShield &lcd);
+	void clear();
+	virtual size_t write(uint8_t c);
+	size_t write(const uint8_t *buffer, size_t size) override;
+	void scrollBack(uint8_t lines);
+private:
+	enum dimensions {
+		columns = 16,
+		rows = 2,
+		ringLines = 4,
+		tabSize = 4
+	};
+	RgbLcdShield &_lcd;
+	uint8_t _ring[ringLines][columns];
+	uint8_t _newest;	// ring index of the line being written
+	uint8_t _lines;		// number of lines in the ring
+	uint8_t _col;
+	uint8_t _row;		// display row of the line being written
+	uint8_t _view;		// number of lines scrolled back
+	uint8_t _top();
+	void _put(uint8_t c, uint8_t &start);
+	void _flush(uint8_t start);
+	void _newLine();
+	void _redraw(uint8_t oldTop);
+	void _redrawRow(uint8_t row, const uint8_t *oldLine,
+			const uint8_t *newLine);
+};
+
+/*
+ * Keeps a copy of the intended display contents and repairs corrupted
+ * characters a few cells per service() call. Text must be written through
+ * the scrubber, left to right. UTF-8 text is kept as the character codes
+ * it was mapped to.
+ */
+class LcdScrubber: public Print, private LcdTextSink {
+public:
+	using Print::write; // pull in write(str) and write(buf, size) from Print
+
+	LcdScrubber(RgbLcdShield &lcd);
+	void clear();
+	void setCursor(uint8_t col, uint8_t row);
+	void createChar(uint8_t location, const uint8_t *charmap);
+#ifdef __AVR__
+	void createCharP(uint8_t location, const uint8_t *charmap);
+#endif // __AVR__
+	virtual size_t write(uint8_t c);
+	size_t write(const uint8_t *buffer, size_t size) override;
+	void service();
+	void setCellsPerTick(uint8_t cells);
+	uint16_t getDetected();
+	uint16_t getRepaired();
+	void clearCounters();
+private:
+	enum dimensions {
+		columns = 16,
+		rows = 2,
+		cells = columns * rows,
+		cgramLocations = 8,
+		cgramRows = 8
+	};
+	RgbLcdShield &_lcd;
+	uint8_t _cells[cells];
+	// the charmaps are not copied, they must stay valid
+	const uint8_t *_charmap[cgramLocations];
+	uint8_t _charmapInProgmem;
+	uint8_t _col;
+	uint8_t _row;
+	// next cell to check, followed by the CGRAM locations
+	uint8_t _next;
+	uint8_t _cellsPerTick;
+	uint16_t _detected;
+	uint16_t _repaired;
+	void put(uint8_t code) override;
+	uint8_t _scrubCells(uint8_t budget);
+	void _scrubCharmap(uint8_t location);
 };
 
 